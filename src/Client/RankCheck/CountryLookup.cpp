@@ -1,6 +1,5 @@
 #include <Client/RankCheck/CountryLookup.hpp>
-#include <SFML/Network/Http.hpp>
-#include <Shared/Utils/MakeUnique.hpp>
+#include <Shared/Utils/DebugLog.hpp>
 #include <Shared/Utils/Utilities.hpp>
 #include <algorithm>
 #include <iterator>
@@ -9,57 +8,114 @@
 
 const std::string CountryLookup::invalidCountry = "XX";
 
-CountryLookup::CountryLookup() :
+// The country of an address changes rarely, but a lookup failure may be temporary.
+static const sf::Int64 countryTimeToLive = 30 * 24 * 60 * 60;
+static const sf::Int64 invalidCountryTimeToLive = 5 * 60;
+static const std::size_t maxCachedCountries = 4096;
+
+CountryLookup::CountryLookup(HttpClient & client, ThreadPool & pool) :
+	client(client),
+	pool(pool),
+	cache("countries.cache", maxCachedCountries, countryTimeToLive),
+	onlineFallback(true),
+	cancelFlag(std::make_shared<std::atomic_bool>(false)),
 	port(0)
 {
-	cache.emplace(sf::IpAddress::None, invalidCountry);
 }
 
 CountryLookup::~CountryLookup()
 {
-	for (const auto & conn : connections)
-	{
-		conn->thread.join();
-	}
+	cancel();
 }
 
 void CountryLookup::lookup(sf::IpAddress address, Callback callback)
 {
-	auto cacheEntry = cache.find(address);
-	if (cacheEntry != cache.end())
+	if (address == sf::IpAddress::None)
 	{
-		callback(cacheEntry->second);
+		callback(invalidCountry);
 		return;
 	}
 
-	std::unique_ptr<Connection> conn = makeUnique<Connection>();
-	conn->callback = callback;
-	conn->address = address;
-	Connection * connPtr = conn.get();
+	// The local player's public address is only known to the online service, which sees where the request comes from.
+	std::string tableCountry;
+	if (geoIPTable.isOpen() && address != sf::IpAddress::LocalHost && geoIPTable.lookup(address, tableCountry))
+	{
+		callback(tableCountry);
+		return;
+	}
 
-	conn->thread = std::thread([this,connPtr]()
+	if (!onlineFallback)
 	{
-		sf::Http http;
-		http.setHost(host, port);
+		callback(invalidCountry);
+		return;
+	}
 
-		std::string addressString;
-		if (connPtr->address != sf::IpAddress::LocalHost)
-		{
-			addressString = connPtr->address.toString();
-		}
+	std::string cachedCountry;
+	if (cache.get(address.toString(), cachedCountry))
+	{
+		callback(cachedCountry);
+		return;
+	}
+
+	auto inFlight = inFlightRequests.find(address.toString());
+	if (inFlight != inFlightRequests.end())
+	{
+		inFlight->second->push_back(std::move(callback));
+		return;
+	}
 
-		sf::Http::Request request;
-		request.setUri(uriPrefix + addressString + uriSuffix);
+	std::string addressString;
+	if (address != sf::IpAddress::LocalHost)
+	{
+		addressString = address.toString();
+	}
 
-		sf::Http::Response response = http.sendRequest(request);
+	HttpClient & client = this->client;
+	std::string host = this->host;
+	unsigned short port = this->port;
+	std::string uri = uriPrefix + addressString + uriSuffix;
+	HttpClient::CancelFlag cancelled = cancelFlag;
+	auto answered = std::make_shared<bool>(false);
+	auto country = std::make_shared<std::string>();
+	auto callbacks = std::make_shared<std::vector<Callback> >(1, std::move(callback));
+	inFlightRequests[address.toString()] = callbacks;
 
-		std::vector<std::string> split;
-		splitString(response.getBody(), ",", split);
-		connPtr->result = (split.size() < 2 || split[1].size() != 2) ? invalidCountry : split[1];
-		connPtr->done = true;
-	});
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<ThreadPool::Job> & job)
+	{
+		return job->isFinished();
+	}), jobs.end());
 
-	connections.push_back(std::move(conn));
+	jobs.push_back(pool.submit([&client,host,port,uri,cancelled,answered,country]()
+	{
+		HttpClient::Response response = client.get(host, port, uri, cancelled);
+		*answered = (response.status != 0);
+		*country = parseResponse(response.body);
+	},
+	[this,address,callbacks,answered,country]()
+	{
+		auto inFlight = inFlightRequests.find(address.toString());
+		if (inFlight != inFlightRequests.end() && inFlight->second == callbacks)
+		{
+			inFlightRequests.erase(inFlight);
+		}
+
+		// A server that did not answer says nothing about the address, so the failure is not cached.
+		if (*answered)
+		{
+			if (*country == invalidCountry)
+			{
+				cache.set(address.toString(), *country, invalidCountryTimeToLive);
+			}
+			else
+			{
+				cache.set(address.toString(), *country);
+			}
+		}
+		for (const auto & callback : *callbacks)
+		{
+			callback(*country);
+		}
+	}));
 }
 
 void CountryLookup::setHost(std::string host, unsigned short port)
@@ -74,21 +130,40 @@ void CountryLookup::setUriParameters(std::string prefix, std::string suffix)
 	uriSuffix = suffix;
 }
 
-void CountryLookup::process()
+void CountryLookup::setOfflineParameters(bool useTable, bool onlineFallback)
 {
-	for (auto it = connections.begin(); it != connections.end();)
+	this->onlineFallback = onlineFallback;
+
+	if (!useTable)
 	{
-		Connection & connection = **it;
-		if (connection.done)
-		{
-			cache.insert(std::make_pair(connection.address, connection.result));
-			connection.callback(connection.result);
-			connection.thread.detach();
-			it = connections.erase(it);
-		}
-		else
-		{
-			++it;
-		}
+		geoIPTable.close();
+	}
+	else if (!geoIPTable.isOpen() && geoIPTable.open(GeoIPTable::getDefaultFilename()))
+	{
+		debug() << "Loaded GeoIP table with " << geoIPTable.getRangeCount() << " ranges";
 	}
 }
+
+void CountryLookup::saveCache()
+{
+	cache.save();
+}
+
+void CountryLookup::cancel()
+{
+	inFlightRequests.clear();
+	*cancelFlag = true;
+	cancelFlag = std::make_shared<std::atomic_bool>(false);
+	for (const auto & job : jobs)
+	{
+		job->cancel();
+	}
+	jobs.clear();
+}
+
+std::string CountryLookup::parseResponse(const std::string & response)
+{
+	std::vector<std::string> split;
+	splitString(response, ",", split);
+	return (split.size() < 2 || split[1].size() != 2) ? invalidCountry : split[1];
+}
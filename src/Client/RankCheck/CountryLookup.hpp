@@ -1,17 +1,17 @@
 #ifndef SRC_CLIENT_RANKCHECK_COUNTRYLOOKUP_HPP_
 #define SRC_CLIENT_RANKCHECK_COUNTRYLOOKUP_HPP_
 
+#include <Client/RankCheck/GeoIPTable.hpp>
+#include <Client/RankCheck/HttpClient.hpp>
+#include <Client/RankCheck/LookupCache.hpp>
 #include <SFML/Network/IpAddress.hpp>
+#include <Shared/Utils/ThreadPool.hpp>
 #include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
-#include <thread>
 #include <vector>
-#include <mutex>
-#include <thread>
-#include <condition_variable>
 
 class CountryLookup
 {
@@ -19,7 +19,10 @@ public:
 
 	static const std::string invalidCountry;
 
-	CountryLookup();
+	/**
+	 * Lookups are sent on the pool's threads, and the callbacks are run by ThreadPool::processCallbacks().
+	 */
+	CountryLookup(HttpClient & client, ThreadPool & pool);
 	~CountryLookup();
 
 	using Callback = std::function<void(std::string)>;
@@ -27,22 +30,39 @@ public:
 	void setHost(std::string host, unsigned short port);
 	void setUriParameters(std::string prefix, std::string suffix);
 
+	/**
+	 * Sets whether addresses are looked up in the offline GeoIP table, if one is installed, and whether addresses that
+	 * the table does not contain are looked up online.
+	 */
+	void setOfflineParameters(bool useTable, bool onlineFallback);
+
 	void lookup(sf::IpAddress address, Callback callback);
-	void process();
+
+	/**
+	 * Drops all pending lookups without calling their callbacks.
+	 */
+	void cancel();
+
+	/**
+	 * Writes the cached countries to disk, if any have been added.
+	 */
+	void saveCache();
 
 private:
 
-	struct Connection
-	{
-		sf::IpAddress address;
-		std::atomic_bool done = ATOMIC_VAR_INIT(false);
-		std::thread thread;
-		std::string result;
-		Callback callback;
-	};
-
-	std::map<sf::IpAddress, std::string> cache;
-	std::vector<std::unique_ptr<Connection> > connections;
+	static std::string parseResponse(const std::string & response);
+
+	HttpClient & client;
+	ThreadPool & pool;
+	LookupCache cache;
+	GeoIPTable geoIPTable;
+	bool onlineFallback;
+	std::vector<std::shared_ptr<ThreadPool::Job> > jobs;
+
+	// Callbacks of the lookups that have been sent but not answered yet, by address.
+	std::map<std::string, std::shared_ptr<std::vector<Callback> > > inFlightRequests;
+	// Shared with the requests sent so far, which are abandoned once it is set. Replaced by cancel().
+	std::shared_ptr<std::atomic_bool> cancelFlag;
 	std::string host;
 	std::string uriPrefix;
 	std::string uriSuffix;
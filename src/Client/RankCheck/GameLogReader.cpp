@@ -5,6 +5,17 @@
 GameLogReader::GameLogReader() :
 	inGame(false)
 {
+	addLineHandler("\tGameManager constructor starts", [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		debug() << "Match has started!";
+		inGame = true;
+	});
+
+	addLineHandler("\tGameManager destructor starts", [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		debug() << "Match has ended!";
+		inGame = false;
+	});
 }
 
 GameLogReader::~GameLogReader()
@@ -25,21 +36,6 @@ void GameLogReader::onReopenFileSuccess()
 {
 }
 
-void GameLogReader::onProcessLine(const std::string& line, bool withCallback)
-{
-	parseGameStart(line, [=]
-	{
-		debug() << "Match has started!";
-		inGame = true;
-	});
-
-	parseGameEnd(line, [=]
-	{
-		debug() << "Match has ended!";
-		inGame = false;
-	});
-}
-
 std::vector<std::string> GameLogReader::getFileNameList() const
 {
 	std::vector<std::string> names;
@@ -49,23 +45,3 @@ std::vector<std::string> GameLogReader::getFileNameList() const
 	}
 	return names;
 }
-
-void GameLogReader::parseGameStart(const std::string& line, std::function<void()> callback)
-{
-	static const std::string gameStartKey = "\tGameManager constructor starts";
-
-	if (line.find(gameStartKey) != std::string::npos)
-	{
-		callback();
-	}
-}
-
-void GameLogReader::parseGameEnd(const std::string& line, std::function<void()> callback)
-{
-	static const std::string gameEndKey = "\tGameManager destructor starts";
-
-	if (line.find(gameEndKey) != std::string::npos)
-	{
-		callback();
-	}
-}
@@ -0,0 +1,250 @@
+#include <Client/RankCheck/GeoIPTable.hpp>
+#include <Poco/Path.h>
+#include <Shared/Utils/DataStream.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <Shared/Utils/Endian.hpp>
+#include <Shared/Utils/Utilities.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static constexpr sf::Int32 HEADER = 1333342;
+static constexpr sf::Int16 VERSION = 0;
+
+// Header, version and range count.
+static constexpr std::size_t HEADER_SIZE = 10;
+
+// First address, last address and country code.
+static constexpr std::size_t RANGE_SIZE = 10;
+
+static sf::Uint16 readUint16(const char * data)
+{
+	sf::Uint16 value;
+	std::memcpy(&value, data, sizeof(value));
+	return n2hs(value);
+}
+
+static sf::Uint32 readUint32(const char * data)
+{
+	sf::Uint32 value;
+	std::memcpy(&value, data, sizeof(value));
+	return n2hl(value);
+}
+
+// Parses a dotted or numeric IPv4 address. Returns false for anything else, such as IPv6 addresses and column names.
+static bool parseAddress(const std::string & string, sf::Uint32 & address)
+{
+	if (string.empty() || string.size() > 15 || string.find_first_not_of("0123456789.") != std::string::npos)
+	{
+		return false;
+	}
+
+	if (string.find('.') == std::string::npos)
+	{
+		sf::Uint64 value = std::strtoull(string.c_str(), nullptr, 10);
+		address = value;
+		return value <= 0xFFFFFFFF;
+	}
+
+	std::vector<std::string> parts;
+	splitString(string, ".", parts);
+	if (parts.size() != 4)
+	{
+		return false;
+	}
+
+	address = 0;
+	for (const auto & part : parts)
+	{
+		unsigned long value = std::strtoul(part.c_str(), nullptr, 10);
+		if (part.empty() || value > 255)
+		{
+			return false;
+		}
+		address = (address << 8) | value;
+	}
+	return true;
+}
+
+static std::string unquote(const std::string & string)
+{
+	std::size_t begin = string.find_first_not_of(" \t\"");
+	std::size_t end = string.find_last_not_of(" \t\"\r");
+	return begin == std::string::npos ? "" : string.substr(begin, end - begin + 1);
+}
+
+GeoIPTable::GeoIPTable() :
+	ranges(nullptr),
+	rangeCount(0)
+{
+}
+
+GeoIPTable::~GeoIPTable()
+{
+}
+
+bool GeoIPTable::open(const std::string & filename)
+{
+	close();
+
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	const char * data = file.getData();
+	std::size_t size = file.getSize();
+	if (size < HEADER_SIZE || sf::Int32(readUint32(data)) != HEADER || sf::Int16(readUint16(data + 4)) != VERSION
+		|| (size - HEADER_SIZE) / RANGE_SIZE < readUint32(data + 6))
+	{
+		debug() << "Ignoring invalid GeoIP table " << filename;
+		file.close();
+		return false;
+	}
+
+	ranges = data + HEADER_SIZE;
+	rangeCount = readUint32(data + 6);
+	return true;
+}
+
+void GeoIPTable::close()
+{
+	file.close();
+	ranges = nullptr;
+	rangeCount = 0;
+}
+
+bool GeoIPTable::isOpen() const
+{
+	return file.isOpen();
+}
+
+std::size_t GeoIPTable::getRangeCount() const
+{
+	return rangeCount;
+}
+
+bool GeoIPTable::lookup(sf::IpAddress address, std::string & countryCode) const
+{
+	sf::Uint32 value = address.toInteger();
+
+	// Find the last range starting at or before the address.
+	std::size_t begin = 0;
+	std::size_t end = rangeCount;
+	while (begin < end)
+	{
+		std::size_t middle = begin + (end - begin) / 2;
+		if (readUint32(ranges + middle * RANGE_SIZE) <= value)
+		{
+			begin = middle + 1;
+		}
+		else
+		{
+			end = middle;
+		}
+	}
+
+	if (begin == 0)
+	{
+		return false;
+	}
+
+	const char * range = ranges + (begin - 1) * RANGE_SIZE;
+	if (readUint32(range + 4) < value)
+	{
+		return false;
+	}
+
+	countryCode.assign(range + 8, 2);
+	return true;
+}
+
+bool GeoIPTable::convertCSV(const std::string & csvFilename, const std::string & tableFilename)
+{
+	struct Range
+	{
+		sf::Uint32 first;
+		sf::Uint32 last;
+		std::string countryCode;
+	};
+
+	std::ifstream csv(csvFilename);
+	if (!csv)
+	{
+		debug() << "Failed to open GeoIP database " << csvFilename;
+		return false;
+	}
+
+	std::vector<Range> ranges;
+	std::size_t skippedLines = 0;
+	std::string line;
+	std::vector<std::string> columns;
+	while (std::getline(csv, line))
+	{
+		splitString(line, ",", columns);
+
+		Range range;
+		if (columns.size() < 3 || !parseAddress(unquote(columns[0]), range.first)
+			|| !parseAddress(unquote(columns[1]), range.last) || range.first > range.last)
+		{
+			++skippedLines;
+			continue;
+		}
+
+		range.countryCode = unquote(columns[2]);
+		if (range.countryCode.size() != 2 || !std::isupper(static_cast<unsigned char>(range.countryCode[0]))
+			|| !std::isupper(static_cast<unsigned char>(range.countryCode[1])))
+		{
+			++skippedLines;
+			continue;
+		}
+
+		ranges.push_back(range);
+	}
+
+	std::sort(ranges.begin(), ranges.end(), [](const Range & left, const Range & right)
+	{
+		return left.first < right.first;
+	});
+
+	// A lookup only checks the last range starting before an address, so ranges must not overlap.
+	std::size_t overlappingRanges = 0;
+	std::size_t rangeCount = 0;
+	for (std::size_t i = 0; i < ranges.size(); ++i)
+	{
+		if (rangeCount > 0 && ranges[i].first <= ranges[rangeCount - 1].last)
+		{
+			++overlappingRanges;
+			continue;
+		}
+		ranges[rangeCount++] = ranges[i];
+	}
+	ranges.resize(rangeCount);
+
+	DataStream stream;
+	if (!stream.openOutFile(tableFilename))
+	{
+		debug() << "Failed to write GeoIP table " << tableFilename;
+		return false;
+	}
+
+	stream << HEADER << VERSION << sf::Uint32(ranges.size());
+	for (const auto & range : ranges)
+	{
+		stream << range.first << range.last << sf::Int8(range.countryCode[0]) << sf::Int8(range.countryCode[1]);
+	}
+
+	debug() << "Converted " << ranges.size() << " GeoIP ranges, skipped " << skippedLines << " lines and "
+		<< overlappingRanges << " overlapping ranges";
+	return true;
+}
+
+std::string GeoIPTable::getDefaultFilename()
+{
+	Poco::Path dir(Poco::Path::dataHome());
+	dir.pushDirectory("rankcheck");
+	return Poco::Path(dir, "geoip.table").toString();
+}
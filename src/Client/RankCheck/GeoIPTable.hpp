@@ -0,0 +1,56 @@
+#ifndef SRC_CLIENT_RANKCHECK_GEOIPTABLE_HPP_
+#define SRC_CLIENT_RANKCHECK_GEOIPTABLE_HPP_
+
+#include <SFML/Network/IpAddress.hpp>
+#include <Shared/Utils/Filesystem/MappedFile.hpp>
+#include <cstddef>
+#include <string>
+
+/**
+ * Offline table of IPv4 address ranges and the countries they belong to.
+ *
+ * The table file holds the ranges sorted by their first address and is memory-mapped, so that a lookup is a binary
+ * search over the mapped ranges and does not touch the network. Table files are created from CSV range databases with
+ * convertCSV().
+ */
+class GeoIPTable
+{
+public:
+
+	GeoIPTable();
+	~GeoIPTable();
+
+	/**
+	 * Maps the specified table file. Returns false if the file does not exist or is not a valid table.
+	 */
+	bool open(const std::string & filename);
+	void close();
+
+	bool isOpen() const;
+	std::size_t getRangeCount() const;
+
+	/**
+	 * Finds the two-letter country code of an address. Returns false if the address is not in any range.
+	 */
+	bool lookup(sf::IpAddress address, std::string & countryCode) const;
+
+	/**
+	 * Converts a CSV range database into a table file. Each line holds the first address, the last address and the
+	 * country code of a range, either as dotted or as numeric addresses, optionally in quotes. Other columns, IPv6
+	 * ranges and header lines are skipped. Returns false if the CSV file cannot be read or the table cannot be written.
+	 */
+	static bool convertCSV(const std::string & csvFilename, const std::string & tableFilename);
+
+	/**
+	 * Returns the location of the table file in RankCheck's data directory.
+	 */
+	static std::string getDefaultFilename();
+
+private:
+
+	fs::MappedFile file;
+	const char * ranges;
+	std::size_t rangeCount;
+};
+
+#endif
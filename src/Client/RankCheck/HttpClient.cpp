@@ -0,0 +1,423 @@
+#include <Client/RankCheck/HttpClient.hpp>
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/SocketSelector.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Sleep.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <Shared/Utils/MakeUnique.hpp>
+#include <Shared/Utils/StrNumCon.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <random>
+#include <utility>
+
+// Longest uninterrupted wait for the server. Cancelling a request takes effect within this time.
+static const sf::Time pollInterval = sf::milliseconds(100);
+
+// Resolving the host and connecting cannot be interrupted, so connecting is limited separately. A request cancelled
+// during this time is only abandoned once the connection is established or has failed.
+static const sf::Time maxConnectTimeout = sf::seconds(5);
+
+// Waits for the specified time. Returns false if the request was cancelled in the meantime.
+static bool waitUnlessCancelled(sf::Time time, const std::atomic_bool * cancelled)
+{
+	sf::Clock clock;
+	while (!cancelled || !*cancelled)
+	{
+		sf::Time remaining = time - clock.getElapsedTime();
+		if (remaining <= sf::Time::Zero)
+		{
+			return true;
+		}
+		sf::sleep(std::min(remaining, pollInterval));
+	}
+	return false;
+}
+
+struct HttpClient::Connection
+{
+	sf::TcpSocket socket;
+	sf::SocketSelector selector;
+
+	// Received data that has not been consumed yet.
+	std::string buffer;
+	bool disconnected = false;
+
+	// Limits of the current request.
+	sf::Clock clock;
+	sf::Time timeout;
+	const std::atomic_bool * cancelled = nullptr;
+	bool timedOut = false;
+
+	bool connect(const std::string & host, unsigned short port)
+	{
+		if (socket.connect(sf::IpAddress(host), port, std::min(timeout, maxConnectTimeout)) != sf::Socket::Done)
+		{
+			return false;
+		}
+		selector.add(socket);
+		return true;
+	}
+
+	void startRequest(sf::Time timeout, const std::atomic_bool * cancelled)
+	{
+		clock.restart();
+		this->timeout = timeout;
+		this->cancelled = cancelled;
+		timedOut = false;
+	}
+
+	// Receives more data into the buffer. Returns false if the connection was closed or failed, or if the request
+	// timed out or was cancelled.
+	bool receive()
+	{
+		while (!disconnected)
+		{
+			if (cancelled && *cancelled)
+			{
+				disconnected = true;
+				break;
+			}
+
+			sf::Time remaining = timeout - clock.getElapsedTime();
+			if (remaining <= sf::Time::Zero)
+			{
+				timedOut = true;
+				disconnected = true;
+				break;
+			}
+
+			if (selector.wait(std::min(remaining, pollInterval)))
+			{
+				break;
+			}
+		}
+
+		char data[4096];
+		std::size_t received = 0;
+		if (disconnected || socket.receive(data, sizeof(data), received) != sf::Socket::Done)
+		{
+			disconnected = true;
+			return false;
+		}
+		buffer.append(data, received);
+		return true;
+	}
+
+	// Reads a line terminated by CRLF, without the terminator.
+	bool readLine(std::string & line)
+	{
+		std::size_t end;
+		while ((end = buffer.find("\r\n")) == std::string::npos)
+		{
+			if (!receive())
+			{
+				return false;
+			}
+		}
+		line = buffer.substr(0, end);
+		buffer.erase(0, end + 2);
+		return true;
+	}
+
+	bool readBytes(std::size_t count, std::string & data)
+	{
+		while (buffer.size() < count)
+		{
+			if (!receive())
+			{
+				return false;
+			}
+		}
+		data.append(buffer, 0, count);
+		buffer.erase(0, count);
+		return true;
+	}
+
+	void readUntilClosed(std::string & data)
+	{
+		while (receive())
+		{
+		}
+		data += buffer;
+		buffer.clear();
+	}
+};
+
+static std::string toLower(std::string string)
+{
+	std::transform(string.begin(), string.end(), string.begin(), [](char c)
+	{
+		return std::tolower(static_cast<unsigned char>(c));
+	});
+	return string;
+}
+
+static std::string trim(const std::string & string)
+{
+	std::size_t begin = string.find_first_not_of(" \t");
+	std::size_t end = string.find_last_not_of(" \t");
+	return begin == std::string::npos ? "" : string.substr(begin, end - begin + 1);
+}
+
+HttpClient::HttpClient(std::size_t maxIdleConnections) :
+	maxIdleConnections(maxIdleConnections),
+	timeout(sf::seconds(10)),
+	retryCount(2),
+	retryDelay(sf::milliseconds(500)),
+	random(std::random_device()())
+{
+}
+
+HttpClient::~HttpClient()
+{
+}
+
+void HttpClient::setTimeout(sf::Time timeout)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->timeout = timeout;
+}
+
+void HttpClient::setRetryParameters(unsigned int retryCount, sf::Time retryDelay)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->retryCount = retryCount;
+	this->retryDelay = retryDelay;
+}
+
+HttpClient::Response HttpClient::get(std::string host, unsigned short port, std::string uri, CancelFlag cancelled)
+{
+	// Same conventions as sf::Http.
+	if (toLower(host.substr(0, 7)) == "http://")
+	{
+		host.erase(0, 7);
+	}
+	if (port == 0)
+	{
+		port = 80;
+	}
+	if (uri.empty() || uri[0] != '/')
+	{
+		uri.insert(0, "/");
+	}
+
+	HostKey key(host, port);
+
+	std::string message = "GET " + uri + " HTTP/1.1\r\n"
+		"Host: " + host + (port == 80 ? "" : ":" + cNtoS(port)) + "\r\n"
+		"User-Agent: RankCheck\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n";
+
+	sf::Time timeout;
+	unsigned int retryCount;
+	sf::Time retryDelay;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		timeout = this->timeout;
+		retryCount = this->retryCount;
+		retryDelay = this->retryDelay;
+	}
+
+	for (unsigned int attempt = 0; ; ++attempt)
+	{
+		Response response = sendRequest(key, message, timeout, cancelled.get());
+		if ((response.status != 0 && response.status / 100 != 5) || attempt >= retryCount)
+		{
+			return response;
+		}
+
+		// The delay is randomized, so that requests that failed at the same time are not all repeated at the same time.
+		float jitter;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jitter = std::uniform_real_distribution<float>(0.5f, 1.5f)(random);
+		}
+		sf::Time delay = retryDelay * (jitter * (1 << std::min(attempt, 16u)));
+
+		debug() << "Request to " << host << ":" << port << " failed, retrying in " << delay.asSeconds() << " seconds";
+		if (!waitUnlessCancelled(delay, cancelled.get()))
+		{
+			return response;
+		}
+	}
+}
+
+HttpClient::Response HttpClient::sendRequest(const HostKey & key, const std::string & message, sf::Time timeout,
+	const std::atomic_bool * cancelled)
+{
+	const std::string & host = key.first;
+	unsigned short port = key.second;
+	Response response;
+
+	auto failure = [&response](const Connection & connection)
+	{
+		response.timedOut = connection.timedOut;
+		return response;
+	};
+
+	// A reused connection may have been closed by the server since its last request, which only shows once the
+	// request is sent. The request is then sent again on a new connection.
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		std::unique_ptr<Connection> connection = takeIdleConnection(key);
+		bool reused = (connection != nullptr);
+		if (!reused)
+		{
+			connection = makeUnique<Connection>();
+		}
+		connection->startRequest(timeout, cancelled);
+
+		if (!reused)
+		{
+			if (cancelled && *cancelled)
+			{
+				return response;
+			}
+			if (!connection->connect(host, port))
+			{
+				debug() << "Failed to connect to " << host << ":" << port;
+				return response;
+			}
+		}
+
+		std::string statusLine;
+		if (connection->socket.send(message.data(), message.size()) != sf::Socket::Done
+			|| !connection->readLine(statusLine))
+		{
+			// A cancelled request also ends with nothing received, but must not be sent again.
+			if (cancelled && *cancelled)
+			{
+				return failure(*connection);
+			}
+			if (reused && connection->buffer.empty() && !connection->timedOut)
+			{
+				continue;
+			}
+			debug() << "No response from " << host << ":" << port;
+			return failure(*connection);
+		}
+
+		// Status line: "HTTP/1.1 200 OK".
+		std::size_t codeBegin = statusLine.find(' ');
+		if (statusLine.compare(0, 5, "HTTP/") != 0 || codeBegin == std::string::npos)
+		{
+			debug() << "Invalid response from " << host << ":" << port;
+			return response;
+		}
+		bool http10 = (statusLine.compare(0, 8, "HTTP/1.0") == 0);
+		int status = std::atoi(statusLine.c_str() + codeBegin + 1);
+
+		std::map<std::string, std::string> headers;
+		std::string line;
+		while (true)
+		{
+			if (!connection->readLine(line))
+			{
+				return failure(*connection);
+			}
+			if (line.empty())
+			{
+				break;
+			}
+			std::size_t colon = line.find(':');
+			if (colon != std::string::npos)
+			{
+				headers[toLower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+			}
+		}
+
+		std::string connectionHeader = toLower(headers["connection"]);
+		bool keepAlive = http10 ? connectionHeader == "keep-alive" : connectionHeader != "close";
+
+		std::string body;
+		if (status / 100 == 1 || status == 204 || status == 304)
+		{
+			// No body.
+		}
+		else if (toLower(headers["transfer-encoding"]).find("chunked") != std::string::npos)
+		{
+			while (true)
+			{
+				if (!connection->readLine(line))
+				{
+					return failure(*connection);
+				}
+				std::size_t chunkSize = std::strtoul(line.c_str(), nullptr, 16);
+				if (chunkSize == 0)
+				{
+					break;
+				}
+				std::string crlf;
+				if (!connection->readBytes(chunkSize, body) || !connection->readBytes(2, crlf))
+				{
+					return failure(*connection);
+				}
+			}
+
+			// Skip the trailer.
+			do
+			{
+				if (!connection->readLine(line))
+				{
+					return failure(*connection);
+				}
+			}
+			while (!line.empty());
+		}
+		else if (headers.count("content-length"))
+		{
+			if (!connection->readBytes(std::strtoul(headers["content-length"].c_str(), nullptr, 10), body))
+			{
+				return failure(*connection);
+			}
+		}
+		else
+		{
+			connection->readUntilClosed(body);
+			keepAlive = false;
+			if (connection->timedOut || (cancelled && *cancelled))
+			{
+				return failure(*connection);
+			}
+		}
+
+		response.status = status;
+		response.body = std::move(body);
+
+		if (keepAlive && !connection->disconnected)
+		{
+			returnIdleConnection(key, std::move(connection));
+		}
+		return response;
+	}
+
+	return response;
+}
+
+std::unique_ptr<HttpClient::Connection> HttpClient::takeIdleConnection(const HostKey & key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = idleConnections.find(key);
+	if (it == idleConnections.end() || it->second.empty())
+	{
+		return nullptr;
+	}
+	std::unique_ptr<Connection> connection = std::move(it->second.back());
+	it->second.pop_back();
+	return connection;
+}
+
+void HttpClient::returnIdleConnection(const HostKey & key, std::unique_ptr<Connection> connection)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto & connections = idleConnections[key];
+	if (connections.size() < maxIdleConnections)
+	{
+		connections.push_back(std::move(connection));
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef SRC_CLIENT_RANKCHECK_HTTPCLIENT_HPP_
+#define SRC_CLIENT_RANKCHECK_HTTPCLIENT_HPP_
+
+#include <SFML/System/Time.hpp>
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sf
+{
+class TcpSocket;
+}
+
+/**
+ * HTTP/1.1 client shared by the online lookups, which send their GET requests from the threads of a ThreadPool.
+ *
+ * Connections are kept alive after a request and reused by later requests to the same host, so only the first request
+ * to a host pays for connecting. A request sent on a reused connection that the server has closed in the meantime is
+ * retried once on a new connection. Requests may be sent from several threads at once.
+ *
+ * Each attempt to send a request has to be answered within the timeout. Requests that fail or receive a server error
+ * are repeated a limited number of times after a randomized, exponentially growing delay. A request can be cancelled
+ * from another thread through a shared flag; waiting for the server stops shortly after the flag is set. Connecting to
+ * the server cannot be interrupted, but is limited to a few seconds.
+ */
+class HttpClient
+{
+public:
+
+	struct Response
+	{
+		// HTTP status code, or 0 if no response was received.
+		int status = 0;
+		std::string body;
+
+		// Set if the last attempt was not answered within the timeout.
+		bool timedOut = false;
+	};
+
+	using CancelFlag = std::shared_ptr<const std::atomic_bool>;
+
+	/**
+	 * Keeps up to maxIdleConnections unused connections per host.
+	 */
+	explicit HttpClient(std::size_t maxIdleConnections = 4);
+	~HttpClient();
+
+	/**
+	 * Sends a GET request and waits for the response. The host may be prefixed with "http://"; port 0 stands for the
+	 * default port 80. The request is abandoned as soon as the cancel flag, if any, is set.
+	 */
+	Response get(std::string host, unsigned short port, std::string uri, CancelFlag cancelled = nullptr);
+
+	/**
+	 * Sets the time the server has to answer each attempt of a request.
+	 */
+	void setTimeout(sf::Time timeout);
+
+	/**
+	 * Sets how many times a failed request is repeated, and the delay before the first repetition. The delay doubles
+	 * with each further repetition.
+	 */
+	void setRetryParameters(unsigned int retryCount, sf::Time retryDelay);
+
+private:
+
+	struct Connection;
+
+	using HostKey = std::pair<std::string, unsigned short>;
+
+	Response sendRequest(const HostKey & key, const std::string & message, sf::Time timeout,
+		const std::atomic_bool * cancelled);
+
+	std::unique_ptr<Connection> takeIdleConnection(const HostKey & key);
+	void returnIdleConnection(const HostKey & key, std::unique_ptr<Connection> connection);
+
+	std::size_t maxIdleConnections;
+
+	std::mutex mutex;
+	sf::Time timeout;
+	unsigned int retryCount;
+	sf::Time retryDelay;
+	std::minstd_rand random;
+	std::map<HostKey, std::vector<std::unique_ptr<Connection> > > idleConnections;
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include <Client/RankCheck/LogMonitor.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <chrono>
+#include <utility>
+
+// Time between two passes over all readers. The readers limit their actual disk access separately.
+static const std::chrono::milliseconds processInterval(20);
+
+// Maximum number of events waiting to be picked up by the UI thread.
+static const std::size_t eventQueueCapacity = 1024;
+
+LogMonitor::LogMonitor() :
+	events(eventQueueCapacity),
+	localSteamID(0),
+	sessionActive(false),
+	inGame(false),
+	stateSaveRequested(false),
+	running(true)
+{
+	replayWatcher.setReplayStartCallback([=](std::string replayPath)
+	{
+		currentReplayPath = replayPath;
+	});
+
+	netlogReader.setCallbackStart([=]()
+	{
+		persistentReader.resetPlayers();
+		persistentReader.markMatchStart();
+		stateSaveRequested = true;
+
+		Event event;
+		event.type = Event::SessionStart;
+		emit(std::move(event));
+	});
+
+	netlogReader.setCallbackEnd([=]()
+	{
+		Event event;
+		event.type = Event::SessionEnd;
+		emit(std::move(event));
+
+		// The replay is parsed by processReaders() once the reader mutex is released.
+		if (!currentReplayPath.empty())
+		{
+			Event replayEvent;
+			replayEvent.type = Event::ReplayFound;
+			replayEvent.replayPath = currentReplayPath;
+			emit(std::move(replayEvent));
+		}
+	});
+
+	persistentReader.setPlayerCallback([=](sf::Uint64 steamID)
+	{
+		if (steamID == 0)
+		{
+			steamID = netlogReader.getLocalSteamID();
+		}
+
+		Event event;
+		event.type = Event::PlayerJoined;
+		event.steamID = steamID;
+		event.isLocal = (netlogReader.getLocalSteamID() == steamID);
+		emit(std::move(event));
+	});
+
+	persistentReader.setRatingCallback([=](sf::Int64 diff)
+	{
+		Event event;
+		event.type = Event::RatingUploaded;
+		event.ratingDiff = diff;
+		event.rating = persistentReader.getCurrentRating();
+		emit(std::move(event));
+	});
+
+	thread = std::thread(&LogMonitor::run, this);
+}
+
+LogMonitor::~LogMonitor()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		running = false;
+	}
+	wakeCondition.notify_all();
+	thread.join();
+}
+
+void LogMonitor::initWithConfig(const cfg::Config & config)
+{
+	std::lock_guard<std::mutex> lock(readerMutex);
+	replayWatcher.initWithConfig(config);
+	netlogReader.initWithConfig(config);
+	gamelogReader.initWithConfig(config);
+	persistentReader.initWithConfig(config);
+}
+
+bool LogMonitor::pollEvent(Event & event)
+{
+	return events.pop(event);
+}
+
+sf::Uint64 LogMonitor::getLocalSteamID() const
+{
+	return localSteamID;
+}
+
+bool LogMonitor::isSessionActive() const
+{
+	return sessionActive;
+}
+
+bool LogMonitor::isInGame() const
+{
+	return inGame;
+}
+
+std::set<sf::Uint64> LogMonitor::getLatestPlayers() const
+{
+	std::lock_guard<std::mutex> lock(readerMutex);
+	return persistentReader.getCurrentPlayers().empty() ?
+		persistentReader.getPreviousPlayers() : persistentReader.getCurrentPlayers();
+}
+
+bool LogMonitor::checkStateSaveRequest()
+{
+	return stateSaveRequested.exchange(false);
+}
+
+void LogMonitor::saveState(cfg::Config & config)
+{
+	std::lock_guard<std::mutex> lock(readerMutex);
+	persistentReader.saveState(config);
+}
+
+void LogMonitor::run()
+{
+	while (running)
+	{
+		processReaders();
+
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait_for(lock, processInterval, [this]()
+		{
+			return !running;
+		});
+	}
+}
+
+void LogMonitor::processReaders()
+{
+	std::vector<Event> newEvents;
+
+	{
+		std::lock_guard<std::mutex> lock(readerMutex);
+
+		netlogReader.process();
+		gamelogReader.process();
+		persistentReader.setLocalSteamID(netlogReader.getLocalSteamID());
+		persistentReader.process();
+		replayWatcher.process();
+
+		localSteamID = netlogReader.getLocalSteamID();
+		sessionActive = netlogReader.isSessionActive();
+		inGame = gamelogReader.isInGame();
+
+		if (persistentReader.checkStateSaveRequest())
+		{
+			stateSaveRequested = true;
+		}
+
+		newEvents.swap(unsentEvents);
+	}
+
+	// Hand the events to the UI thread outside of the lock, so that neither a full queue nor reading a replay file
+	// blocks the UI thread.
+	for (auto & event : newEvents)
+	{
+		if (event.type == Event::ReplayFound)
+		{
+			ReplayParser parser(event.replayPath + "/Replays.info");
+			event.replay = std::make_shared<ReplayParser::ReplayInfo>(parser.parse());
+		}
+
+		while (!events.push(std::move(event)))
+		{
+			if (!running)
+			{
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+void LogMonitor::emit(Event event)
+{
+	// Called with the reader mutex held, either from the monitor thread or from initWithConfig().
+	unsentEvents.push_back(std::move(event));
+}
@@ -0,0 +1,120 @@
+#ifndef SRC_CLIENT_RANKCHECK_LOGMONITOR_HPP_
+#define SRC_CLIENT_RANKCHECK_LOGMONITOR_HPP_
+
+#include <Client/RankCheck/GameLogReader.hpp>
+#include <Client/RankCheck/NetworkLogReader.hpp>
+#include <Client/RankCheck/PersistentLogReader.hpp>
+#include <Client/RankCheck/ReplayParser.hpp>
+#include <Client/RankCheck/ReplayWatcher.hpp>
+#include <SFML/Config.hpp>
+#include <Shared/Utils/SPSCQueue.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cfg
+{
+class Config;
+}
+
+/**
+ * Runs all game log readers and the replay watcher on a dedicated background thread.
+ *
+ * Everything the readers detect is reported as a typed event through a single-producer/single-consumer queue, which
+ * the UI thread drains with pollEvent(). The readers themselves are guarded by a mutex, which the UI thread only needs
+ * to acquire for rare operations such as applying the config or saving the persistent log state.
+ */
+class LogMonitor
+{
+public:
+
+	struct Event
+	{
+		enum Type
+		{
+			/// A game session has started.
+			SessionStart,
+
+			/// The current game session has ended.
+			SessionEnd,
+
+			/// A player has joined the current match (steamID, isLocal).
+			PlayerJoined,
+
+			/// The local player's rating has changed (ratingDiff, rating).
+			RatingUploaded,
+
+			/// The replay of the ended session has been parsed (replayPath, replay).
+			ReplayFound
+		};
+
+		Type type = SessionStart;
+		sf::Uint64 steamID = 0;
+		bool isLocal = false;
+		sf::Int64 ratingDiff = 0;
+		sf::Int64 rating = 0;
+		std::string replayPath;
+		std::shared_ptr<const ReplayParser::ReplayInfo> replay;
+	};
+
+	LogMonitor();
+	~LogMonitor();
+
+	void initWithConfig(const cfg::Config & config);
+
+	/**
+	 * Retrieves the oldest pending event. Returns false if there are no pending events.
+	 *
+	 * Must only be called from a single thread.
+	 */
+	bool pollEvent(Event & event);
+
+	sf::Uint64 getLocalSteamID() const;
+	bool isSessionActive() const;
+	bool isInGame() const;
+
+	/**
+	 * Returns the players of the current match, or of the previous match if no match is in progress.
+	 */
+	std::set<sf::Uint64> getLatestPlayers() const;
+
+	/**
+	 * Returns true once if the persistent log reader's state should be saved.
+	 */
+	bool checkStateSaveRequest();
+	void saveState(cfg::Config & config);
+
+private:
+
+	void run();
+	void processReaders();
+	void emit(Event event);
+
+	NetworkLogReader netlogReader;
+	PersistentLogReader persistentReader;
+	GameLogReader gamelogReader;
+	ReplayWatcher replayWatcher;
+	std::string currentReplayPath;
+
+	mutable std::mutex readerMutex;
+
+	std::vector<Event> unsentEvents;
+	SPSCQueue<Event> events;
+
+	std::atomic<sf::Uint64> localSteamID;
+	std::atomic_bool sessionActive;
+	std::atomic_bool inGame;
+	std::atomic_bool stateSaveRequested;
+
+	std::atomic_bool running;
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::thread thread;
+};
+
+#endif
@@ -4,13 +4,21 @@
 #include <Shared/Config/CompositeTypes.hpp>
 #include <Shared/Config/Config.hpp>
 #include <Shared/Utils/DebugLog.hpp>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <utility>
 
 static cfg::Float diskReadInterval("rankcheck.diskReadInterval");
+static cfg::Float diskReadFallbackInterval("rankcheck.diskReadFallbackInterval");
 
-LogReader::LogReader()
+// Size of the blocks that log files are read in.
+static const std::size_t readBlockSize = 64 * 1024;
+
+LogReader::LogReader() :
+	readBuffer(readBlockSize)
 {
-	observer.setEventMask(fs::DirectoryObserver::Event::Added);
+	observer.setEventMask(fs::DirectoryObserver::Event::Added | fs::DirectoryObserver::Event::Modified);
 }
 
 LogReader::~LogReader()
@@ -44,11 +52,9 @@ void LogReader::initWithConfig(const cfg::Config& config)
 		}
 	}
 
-	sf::Time timerInterval = sf::seconds(config.get(diskReadInterval));
-	if (readTimer.getTime() != timerInterval)
-	{
-		readTimer.setTime(timerInterval);
-	}
+	readInterval = sf::seconds(config.get(diskReadInterval));
+	fallbackReadInterval = sf::seconds(config.get(diskReadFallbackInterval));
+	updateReadTimer();
 }
 
 void LogReader::process()
@@ -58,12 +64,14 @@ void LogReader::process()
 		return;
 	}
 
-	if (observer.poll())
+	int events = observer.pollEvents();
+
+	if (events & fs::DirectoryObserver::Event::Added)
 	{
 		reopenFile(false);
 	}
 
-	if (readTimer.tick())
+	if ((events & fs::DirectoryObserver::Event::Modified) || readTimer.tick())
 	{
 		file.clear();
 		auto currentFilePos = file.tellg();
@@ -84,11 +92,7 @@ void LogReader::process()
 
 		if (file.is_open())
 		{
-			std::string line;
-			while (std::getline(file, line))
-			{
-				onProcessLine(line, true);
-			}
+			readLines(true);
 		}
 		else
 		{
@@ -102,8 +106,10 @@ void LogReader::reopenFile(bool initial)
 	onReopenFile();
 
 	debug() << "Opening " << openFileName << " for reading";
-	file.open(openFileName);
+	file.open(openFileName, std::ios::binary);
 	observer.setTargetFile(openFileName);
+	resetReadState(0);
+	updateReadTimer();
 
 	if (file.good())
 	{
@@ -124,10 +130,20 @@ void LogReader::reopenFile(bool initial)
 	}
 }
 
+void LogReader::addLineHandler(std::string key, LineHandler handler)
+{
+	lineMatcher.addPattern(std::move(key));
+	lineHandlers.push_back(std::move(handler));
+}
+
 std::size_t LogReader::tell()
 {
-	file.clear();
-	return file.tellg();
+	return readPosition;
+}
+
+std::size_t LogReader::tellLineStart() const
+{
+	return lineStartPosition;
 }
 
 bool LogReader::onInitRead()
@@ -139,6 +155,7 @@ bool LogReader::seek(std::size_t pos)
 {
 	file.clear();
 	file.seekg(pos);
+	resetReadState(pos);
 	return file.good();
 }
 
@@ -146,18 +163,41 @@ bool LogReader::seekFromEnd(std::size_t pos)
 {
 	file.clear();
 	file.seekg(-sf::Int64(pos), std::ios::end);
+	if (file.good())
+	{
+		resetReadState(file.tellg());
+	}
 	return file.good();
 }
 
-bool LogReader::readInitial()
+std::size_t LogReader::getFileSize()
 {
-	std::string line;
-	while (std::getline(file, line))
-	{
-		onProcessLine(line, false);
-	}
+	file.clear();
+	auto currentFilePos = file.tellg();
+	file.seekg(0, std::ios::end);
+	std::size_t fileSize = file.tellg();
+	file.seekg(currentFilePos);
+	return file.good() ? fileSize : 0;
+}
 
-	if (!file.eof())
+std::string LogReader::peek(std::size_t pos, std::size_t size)
+{
+	file.clear();
+	auto currentFilePos = file.tellg();
+
+	std::string data(size, '\0');
+	file.seekg(pos);
+	file.read(&data[0], size);
+	data.resize(file.gcount());
+
+	file.clear();
+	file.seekg(currentFilePos);
+	return data;
+}
+
+bool LogReader::readInitial()
+{
+	if (!readLines(false))
 	{
 		file.close();
 		return false;
@@ -170,6 +210,164 @@ bool LogReader::readInitial()
 	}
 }
 
+bool LogReader::readLines(bool withCallback)
+{
+	while (file.read(readBuffer.data(), readBuffer.size()) || file.gcount() > 0)
+	{
+		processBlock(readBuffer.data(), file.gcount(), withCallback);
+	}
+
+	return file.eof();
+}
+
+void LogReader::processBlock(const char * data, std::size_t size, bool withCallback)
+{
+	std::size_t blockPosition = readPosition + partialLine.size();
+	const char * lineStart = data;
+	const char * blockEnd = data + size;
+
+	while (lineStart != blockEnd)
+	{
+		const char * lineEnd = static_cast<const char *>(std::memchr(lineStart, '\n', blockEnd - lineStart));
+
+		if (lineEnd == nullptr)
+		{
+			// Keep incomplete line until the rest of it has been read.
+			partialLine.append(lineStart, blockEnd);
+			return;
+		}
+
+		lineStartPosition = readPosition;
+		readPosition = blockPosition + (lineEnd + 1 - data);
+
+		if (partialLine.empty())
+		{
+			processLine(StringView(lineStart, lineEnd - lineStart), withCallback);
+		}
+		else
+		{
+			partialLine.append(lineStart, lineEnd);
+			processLine(partialLine, withCallback);
+			partialLine.clear();
+		}
+
+		lineStart = lineEnd + 1;
+	}
+}
+
+bool LogReader::readLinesBackwards(ReverseLineCallback callback)
+{
+	std::size_t blockEnd = getFileSize();
+	std::string laterPart;
+	bool skippingTail = true;
+
+	while (blockEnd > 0)
+	{
+		std::size_t blockStart = blockEnd > readBuffer.size() ? blockEnd - readBuffer.size() : 0;
+		std::size_t size = blockEnd - blockStart;
+
+		file.clear();
+		file.seekg(blockStart);
+		if (!file.read(readBuffer.data(), size))
+		{
+			return false;
+		}
+
+		const char * data = readBuffer.data();
+		std::size_t lineEnd = size;
+
+		for (std::size_t pos = size; pos > 0; --pos)
+		{
+			if (data[pos - 1] != '\n')
+			{
+				continue;
+			}
+
+			if (skippingTail)
+			{
+				// Skip the incomplete (or empty) line after the last newline.
+				skippingTail = false;
+				laterPart.clear();
+			}
+			else if (laterPart.empty())
+			{
+				if (!callback(stripLineEnding(StringView(data + pos, lineEnd - pos)), blockStart + pos))
+				{
+					return true;
+				}
+			}
+			else
+			{
+				// Line continues in a later block.
+				laterPart.insert(0, data + pos, lineEnd - pos);
+				if (!callback(stripLineEnding(laterPart), blockStart + pos))
+				{
+					return true;
+				}
+				laterPart.clear();
+			}
+
+			lineEnd = pos - 1;
+		}
+
+		// Remainder of the block belongs to a line starting in an earlier block.
+		laterPart.insert(0, data, lineEnd);
+		blockEnd = blockStart;
+	}
+
+	if (!skippingTail)
+	{
+		callback(stripLineEnding(laterPart), 0);
+	}
+
+	return true;
+}
+
+StringView LogReader::stripLineEnding(StringView line)
+{
+	// Strip carriage return from CRLF line endings, since the file is read in binary mode.
+	if (!line.empty() && line[line.size() - 1] == '\r')
+	{
+		return line.substr(0, line.size() - 1);
+	}
+	return line;
+}
+
+void LogReader::processLine(StringView line, bool withCallback)
+{
+	line = stripLineEnding(line);
+
+	if (lineMatcher.match(line, keyPositions) == 0)
+	{
+		return;
+	}
+
+	for (std::size_t i = 0; i < lineHandlers.size(); ++i)
+	{
+		if (keyPositions[i] != StringMatcher::npos)
+		{
+			lineHandlers[i](line, keyPositions[i], withCallback);
+		}
+	}
+}
+
+void LogReader::updateReadTimer()
+{
+	// Only poll at the fallback interval if modifications are being reported by the observer.
+	sf::Time interval = observer.isActive() ? std::max(readInterval, fallbackReadInterval) : readInterval;
+	if (readTimer.getTime() != interval)
+	{
+		readTimer.setTime(interval);
+	}
+}
+
+void LogReader::resetReadState(std::size_t pos)
+{
+	readPosition = pos;
+	lineStartPosition = pos;
+	partialLine.clear();
+}
+
 void LogReader::onInitConfig(const cfg::Config& config)
 {
 }
@@ -3,7 +3,11 @@
 
 #include <SFML/Config.hpp>
 #include <Shared/Utils/Filesystem/FileObserver.hpp>
+#include <Shared/Utils/StringMatcher.hpp>
+#include <Shared/Utils/StringView.hpp>
 #include <Shared/Utils/Timer.hpp>
+#include <cstddef>
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -16,6 +20,16 @@ class Config;
 
 /**
  * Abstract superclass for live-readers of log files.
+ *
+ * The file is read in fixed-size blocks. Complete lines are passed to subclasses as views into the block buffer, so no
+ * per-line allocation takes place. Only lines that span a block boundary are assembled in a separate buffer. A trailing
+ * line without a newline is held back until the rest of it has been written.
+ *
+ * New data is read as soon as the file observer reports a modification. The file size is additionally polled at a
+ * fixed interval, which is lengthened while change notifications are available.
+ *
+ * Subclasses register a handler for each key they are interested in. Every line is scanned for all registered keys in
+ * a single pass, and the handlers of the keys found in it are called in registration order.
  */
 class LogReader
 {
@@ -29,16 +43,54 @@ public:
 
 protected:
 
+	/**
+	 * Line handler, receiving the line, the position of the key within the line, and whether callbacks to the owner of
+	 * the reader should be invoked.
+	 */
+	using LineHandler = std::function<void(StringView line, std::size_t keyPos, bool withCallback)>;
+
+	void addLineHandler(std::string key, LineHandler handler);
+
+	/**
+	 * Reverse line callback, receiving a line and its file offset. Returns false to stop reading.
+	 */
+	using ReverseLineCallback = std::function<bool(StringView line, std::size_t lineStart)>;
+
+	/**
+	 * Reads complete lines from the end of the file towards its start, in fixed-size blocks. An incomplete trailing
+	 * line is skipped. Line handlers are not invoked.
+	 *
+	 * The read position is undefined afterwards; seek() must be called before reading forward again.
+	 */
+	bool readLinesBackwards(ReverseLineCallback callback);
+
 	std::size_t tell();
+	std::size_t tellLineStart() const;
 	bool seek(std::size_t pos);
 	bool seekFromEnd(std::size_t pos);
 	bool readInitial();
 
+	/**
+	 * Returns the current size of the file. Does not affect the read position.
+	 */
+	std::size_t getFileSize();
+
+	/**
+	 * Reads up to size raw bytes starting at the specified offset. Does not affect the read position.
+	 */
+	std::string peek(std::size_t pos, std::size_t size);
+
 private:
 
+	bool readLines(bool withCallback);
+	void processBlock(const char * data, std::size_t size, bool withCallback);
+	void processLine(StringView line, bool withCallback);
+	static StringView stripLineEnding(StringView line);
+	void resetReadState(std::size_t pos);
+	void updateReadTimer();
+
 	virtual void onReopenFile() = 0;
 	virtual void onReopenFileSuccess() = 0;
-	virtual void onProcessLine(const std::string & line, bool withCallback) = 0;
 	virtual std::vector<std::string> getFileNameList() const = 0;
 	virtual bool onInitRead();
 	virtual void onInitConfig(const cfg::Config & config);
@@ -48,7 +100,18 @@ private:
 	fs::FileObserver observer;
 	bool valid = false;
 	Timer readTimer;
+	sf::Time readInterval;
+	sf::Time fallbackReadInterval;
 	sf::Uint64 lastKnownFilesize = 0;
+
+	StringMatcher lineMatcher;
+	std::vector<LineHandler> lineHandlers;
+	std::vector<std::size_t> keyPositions;
+
+	std::vector<char> readBuffer;
+	std::string partialLine;
+	std::size_t readPosition = 0;
+	std::size_t lineStartPosition = 0;
 };
 
 
@@ -0,0 +1,164 @@
+#include <Client/RankCheck/LookupCache.hpp>
+#include <Poco/Path.h>
+#include <Poco/Timestamp.h>
+#include <Shared/Utils/DataStream.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <algorithm>
+#include <utility>
+
+static constexpr sf::Int32 HEADER = 1333341;
+static constexpr sf::Int16 VERSION = 0;
+
+LookupCache::LookupCache(std::string filename, std::size_t maxEntries, sf::Int64 timeToLive) :
+	maxEntries(std::max<std::size_t>(maxEntries, 1)),
+	timeToLive(timeToLive)
+{
+	Poco::Path dir(Poco::Path::dataHome());
+	dir.pushDirectory("rankcheck");
+	CACHE_FILENAME = Poco::Path(dir, filename).toString();
+}
+
+LookupCache::~LookupCache()
+{
+	save();
+}
+
+void LookupCache::setTimeToLive(sf::Int64 timeToLive)
+{
+	this->timeToLive = timeToLive;
+}
+
+void LookupCache::setPersistent(bool persistent)
+{
+	this->persistent = persistent;
+}
+
+bool LookupCache::get(const std::string & key, std::string & value)
+{
+	load();
+
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.expiryTime <= getCurrentTime())
+	{
+		return false;
+	}
+
+	// Usage order is not worth rewriting the file for on its own, so this does not mark the cache as changed.
+	usage.splice(usage.begin(), usage, it->second.usage);
+	value = it->second.value;
+	return true;
+}
+
+void LookupCache::set(const std::string & key, const std::string & value)
+{
+	set(key, value, timeToLive);
+}
+
+void LookupCache::set(const std::string & key, const std::string & value, sf::Int64 timeToLive)
+{
+	load();
+	insert(key, value, getCurrentTime() + timeToLive);
+	changed = true;
+}
+
+void LookupCache::save()
+{
+	if (!changed || !persistent)
+	{
+		return;
+	}
+
+	DataStream stream;
+	if (!stream.openOutFile(CACHE_FILENAME))
+	{
+		debug() << "Failed to write lookup cache " << CACHE_FILENAME;
+		return;
+	}
+
+	// Least recently used first, so that loading restores the usage order by inserting the entries in file order.
+	stream << HEADER << VERSION << sf::Uint32(entries.size());
+	for (auto it = usage.rbegin(); it != usage.rend(); ++it)
+	{
+		const Entry & entry = entries.at(*it);
+		stream << *it << entry.value << entry.expiryTime;
+	}
+	changed = false;
+}
+
+void LookupCache::load()
+{
+	if (loaded || !persistent)
+	{
+		return;
+	}
+	loaded = true;
+
+	DataStream stream;
+	if (!stream.openInFile(CACHE_FILENAME))
+	{
+		return;
+	}
+
+	sf::Int32 header;
+	sf::Int16 version;
+	sf::Uint32 count;
+	stream >> header >> version >> count;
+
+	if (!stream.isValid() || header != HEADER || version != VERSION)
+	{
+		debug() << "Ignoring unrecognized lookup cache " << CACHE_FILENAME;
+		return;
+	}
+
+	sf::Int64 currentTime = getCurrentTime();
+	for (sf::Uint32 i = 0; i < count; ++i)
+	{
+		std::string key;
+		std::string value;
+		sf::Int64 expiryTime;
+		stream >> key >> value >> expiryTime;
+
+		if (!stream.isValid())
+		{
+			debug() << "Ignoring corrupt lookup cache " << CACHE_FILENAME;
+			entries.clear();
+			usage.clear();
+			return;
+		}
+
+		// Expired entries are dropped from the file on the next save. Entries added before the cache became persistent
+		// are newer than the file.
+		if (expiryTime > currentTime && entries.find(key) == entries.end())
+		{
+			insert(key, value, expiryTime);
+		}
+	}
+}
+
+void LookupCache::insert(const std::string & key, const std::string & value, sf::Int64 expiryTime)
+{
+	auto it = entries.find(key);
+	if (it != entries.end())
+	{
+		usage.splice(usage.begin(), usage, it->second.usage);
+	}
+	else
+	{
+		if (entries.size() >= maxEntries)
+		{
+			entries.erase(usage.back());
+			usage.pop_back();
+		}
+		usage.push_front(key);
+		it = entries.emplace(key, Entry()).first;
+		it->second.usage = usage.begin();
+	}
+
+	it->second.value = value;
+	it->second.expiryTime = expiryTime;
+}
+
+sf::Int64 LookupCache::getCurrentTime()
+{
+	return Poco::Timestamp().epochTime();
+}
@@ -0,0 +1,83 @@
+#ifndef SRC_CLIENT_RANKCHECK_LOOKUPCACHE_HPP_
+#define SRC_CLIENT_RANKCHECK_LOOKUPCACHE_HPP_
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Results of online lookups, stored in RankCheck's data directory so that they survive restarts.
+ *
+ * Each entry expires a fixed time after it was added. The cache holds a limited number of entries; when it is full,
+ * the least recently used entry is evicted. The file is only read on the first access, and written by save() if the
+ * cache has changed.
+ */
+class LookupCache
+{
+public:
+
+	/**
+	 * Creates a cache stored in the specified file within the data directory.
+	 */
+	LookupCache(std::string filename, std::size_t maxEntries, sf::Int64 timeToLive);
+	~LookupCache();
+
+	/**
+	 * Sets the number of seconds after which entries added from now on expire.
+	 */
+	void setTimeToLive(sf::Int64 timeToLive);
+
+	/**
+	 * Sets whether the cache is read from and written to its file. A cache that is not persistent only lives in memory.
+	 */
+	void setPersistent(bool persistent);
+
+	/**
+	 * Retrieves the value stored for a key, unless it has expired. Marks the entry as recently used.
+	 */
+	bool get(const std::string & key, std::string & value);
+
+	/**
+	 * Stores a value that expires after the default time to live, or after the specified number of seconds.
+	 */
+	void set(const std::string & key, const std::string & value);
+	void set(const std::string & key, const std::string & value, sf::Int64 timeToLive);
+
+	/**
+	 * Writes the cache to its file if it has changed since it was loaded or last saved.
+	 */
+	void save();
+
+private:
+
+	struct Entry
+	{
+		std::string value;
+		sf::Int64 expiryTime = 0;
+
+		// Position in the usage list.
+		std::list<std::string>::iterator usage;
+	};
+
+	void load();
+	void insert(const std::string & key, const std::string & value, sf::Int64 expiryTime);
+
+	static sf::Int64 getCurrentTime();
+
+	std::string CACHE_FILENAME;
+	std::size_t maxEntries;
+	sf::Int64 timeToLive;
+
+	bool persistent = true;
+	bool loaded = false;
+	bool changed = false;
+
+	std::unordered_map<std::string, Entry> entries;
+
+	// Keys of all entries, most recently used first.
+	std::list<std::string> usage;
+};
+
+#endif
@@ -1,11 +1,307 @@
+#include <Client/RankCheck/GeoIPTable.hpp>
+#include <Client/RankCheck/RankChecker.hpp>
+#include <Client/RankCheck/ReplayParser.hpp>
 #include <Client/System/WOSApplication.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Time.hpp>
+#include <Shared/Config/DataTypes.hpp>
+#include <Shared/Config/JSONConfig.hpp>
+#include <Shared/Utils/StrNumCon.hpp>
+#include <Shared/Utils/Utilities.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
+// Installs a GeoIP table for offline country lookups, converted from a CSV range database.
+static int convertGeoIPTable(const std::vector<std::string> & args)
+{
+	if (args.size() < 3)
+	{
+		std::cerr << "Usage: " << args[0] << " --convert-geoip <csv file> [table file]" << std::endl;
+		return 1;
+	}
+
+	std::string tableFilename = args.size() > 3 ? args[3] : GeoIPTable::getDefaultFilename();
+
+	GeoIPTable table;
+	if (!GeoIPTable::convertCSV(args[2], tableFilename) || !table.open(tableFilename))
+	{
+		std::cerr << "Failed to convert " << args[2] << " to " << tableFilename << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << table.getRangeCount() << " ranges to " << tableFilename << std::endl;
+	return 0;
+}
+
+static bool isSamePlayer(const PlayerData & player1, const PlayerData & player2)
+{
+	return player1.steamID == player2.steamID && player1.currentName == player2.currentName
+		&& player1.type == player2.type && player1.team == player2.team && player1.currentNaut == player2.currentNaut
+		&& player1.currentSkin == player2.currentSkin && player1.isLocal == player2.isLocal;
+}
+
+static bool isSameReplay(const ReplayParser::ReplayInfo & info1, const ReplayParser::ReplayInfo & info2)
+{
+	if (info1.countStats != info2.countStats || !(info1.hash == info2.hash) || info1.localTeam != info2.localTeam
+		|| info1.players.size() != info2.players.size())
+	{
+		return false;
+	}
+
+	for (std::size_t i = 0; i < info1.players.size(); ++i)
+	{
+		if (!isSamePlayer(info1.players[i].player, info2.players[i].player)
+			|| !isSamePlayer(info1.players[i].sponsor, info2.players[i].sponsor))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Compares the streaming pass and the document parser on the Replays.info files of a replay folder.
+static int benchmarkReplayParser(const std::vector<std::string> & args)
+{
+	if (args.size() < 3)
+	{
+		std::cerr << "Usage: " << args[0] << " --benchmark-replays <replay folder> [rounds]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> dirs;
+	std::vector<std::string> files;
+	listDirectories(args[2], dirs, false, true);
+	for (const auto & dir : dirs)
+	{
+		std::string file = args[2] + "/" + dir + "/Replays.info";
+		if (fileExists(file))
+		{
+			files.push_back(file);
+		}
+	}
+
+	if (files.empty())
+	{
+		std::cerr << "No replays found in " << args[2] << std::endl;
+		return 1;
+	}
+
+	std::size_t fallbackCount = 0;
+	std::size_t mismatchCount = 0;
+	for (const auto & file : files)
+	{
+		ReplayParser parser(file);
+		ReplayParser::ReplayInfo streamedInfo;
+		ReplayParser::ReplayInfo documentInfo;
+		if (!parser.parseStreaming(streamedInfo))
+		{
+			++fallbackCount;
+		}
+		else if (parser.parseDocument(documentInfo) && !isSameReplay(streamedInfo, documentInfo))
+		{
+			std::cout << "Different results for " << file << std::endl;
+			++mismatchCount;
+		}
+	}
+
+	// The passes take turns, so that both run with the same files cached.
+	unsigned long rounds = args.size() > 3 ? std::max<unsigned long>(cStoUL(args[3]), 1) : 5;
+	sf::Time streamingTime;
+	sf::Time documentTime;
+	for (unsigned long round = 0; round < rounds; ++round)
+	{
+		sf::Clock clock;
+		for (const auto & file : files)
+		{
+			ReplayParser::ReplayInfo info;
+			ReplayParser(file).parseStreaming(info);
+		}
+		streamingTime += clock.restart();
+
+		for (const auto & file : files)
+		{
+			ReplayParser::ReplayInfo info;
+			ReplayParser(file).parseDocument(info);
+		}
+		documentTime += clock.getElapsedTime();
+	}
+
+	auto perFile = [&](sf::Time time)
+	{
+		return time.asMicroseconds() / double(rounds * files.size());
+	};
+
+	std::cout << files.size() << " replays, " << rounds << " rounds" << std::endl;
+	std::cout << "Streaming: " << perFile(streamingTime) << " us per replay" << std::endl;
+	std::cout << "Document:  " << perFile(documentTime) << " us per replay" << std::endl;
+	std::cout << fallbackCount << " replays need the document parser, " << mismatchCount << " replays differ"
+		<< std::endl;
+	return mismatchCount == 0 ? 0 : 1;
+}
+
+// Reads a leaderboard response the way RankChecker did before it used a SAX handler, for comparison.
+static RankChecker::ParseResult parseLeaderboardDocument(const std::string & json)
+{
+	cfg::JSONConfig config;
+	try
+	{
+		config.loadFromString(json);
+	}
+	catch (std::exception & e)
+	{
+		return RankChecker::ParseResult();
+	}
+
+	auto getInt = [&config](const std::string & key)
+	{
+		return cStoI(config.readValue(key).content);
+	};
+	auto getULong = [&config](const std::string & key)
+	{
+		return cStoUL(config.readValue(key).content);
+	};
+
+	RankChecker::ParseResult result;
+	result.success = true;
+	result.info.entryCount = getULong("totalEntryCount");
+	result.info.lastUpdateTime = getULong("lastUpdate");
+
+	for (std::size_t i = 0; i < getULong("entries.length"); ++i)
+	{
+		std::string prefix = "entries[" + cNtoS(i) + "].";
+
+		RankChecker::Result entry;
+		entry.code = RankChecker::Result::Success;
+		entry.scoredata = std::vector<sf::Int32>(14, -1);
+		entry.steamID = getULong(prefix + "steamid");
+		entry.scoredata[0] = getInt(prefix + "rank");
+		entry.scoredata[1] = getInt(prefix + "rating");
+		entry.scoredata[3] = getInt(prefix + "totalWins");
+		entry.scoredata[4] = getInt(prefix + "totalLosses");
+		entry.scoredata[8] = getInt(prefix + "mainNaut");
+		entry.scoredata[9] = getInt(prefix + "seasonWins");
+		entry.scoredata[10] = getInt(prefix + "seasonLosses");
+		result.entries.emplace(entry.steamID, std::move(entry));
+	}
+
+	return result;
+}
+
+static bool isSameLeaderboard(const RankChecker::ParseResult & result1, const RankChecker::ParseResult & result2)
+{
+	if (result1.success != result2.success || result1.info.entryCount != result2.info.entryCount
+		|| result1.info.lastUpdateTime != result2.info.lastUpdateTime || result1.entries.size() != result2.entries.size())
+	{
+		return false;
+	}
+
+	for (const auto & entry : result1.entries)
+	{
+		auto it = result2.entries.find(entry.first);
+		if (it == result2.entries.end() || it->second.scoredata != entry.second.scoredata)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Builds a leaderboard response with the specified number of entries, shaped like the ones sent by the server.
+static std::string makeLeaderboardResponse(std::size_t entryCount)
+{
+	std::string json = "{\"totalEntryCount\":" + cNtoS(entryCount) + ",\"lastUpdate\":1500000000,\"entries\":[";
+	for (std::size_t i = 0; i < entryCount; ++i)
+	{
+		json += (i == 0 ? "{" : ",{");
+		json += "\"steamid\":\"" + cNtoS(76561197960265728ull + i * 7919) + "\"";
+		json += ",\"name\":\"Player " + cNtoS(i) + "\"";
+		json += ",\"rank\":" + cNtoS(i + 1);
+		json += ",\"rating\":" + cNtoS(3000 - int(i));
+		json += ",\"totalWins\":" + cNtoS(i * 3 % 1000);
+		json += ",\"totalLosses\":" + cNtoS(i * 5 % 1000);
+		json += ",\"mainNaut\":" + cNtoS(i % 33 + 1);
+		json += ",\"seasonWins\":" + cNtoS(i % 100);
+		json += ",\"seasonLosses\":" + cNtoS(i % 77);
+		json += "}";
+	}
+	json += "]}";
+	return json;
+}
+
+// Compares the SAX handler used by RankChecker with the previous document-based parser on a leaderboard response.
+static int benchmarkLeaderboardParser(const std::vector<std::string> & args)
+{
+	std::string json;
+	if (args.size() > 2 && args[2] != "-")
+	{
+		std::ifstream file(args[2], std::ios::binary);
+		std::ostringstream contents;
+		if (!file.is_open() || !(contents << file.rdbuf()))
+		{
+			std::cerr << "Failed to read " << args[2] << std::endl;
+			return 1;
+		}
+		json = contents.str();
+	}
+	else
+	{
+		json = makeLeaderboardResponse(1000);
+	}
+
+	RankChecker::ParseResult handlerResult = RankChecker::parseJSON(json);
+	RankChecker::ParseResult documentResult = parseLeaderboardDocument(json);
+	bool same = isSameLeaderboard(handlerResult, documentResult);
+
+	unsigned long rounds = args.size() > 3 ? std::max<unsigned long>(cStoUL(args[3]), 1) : 20;
+	sf::Time handlerTime;
+	sf::Time documentTime;
+	for (unsigned long round = 0; round < rounds; ++round)
+	{
+		sf::Clock clock;
+		RankChecker::parseJSON(json);
+		handlerTime += clock.restart();
+		parseLeaderboardDocument(json);
+		documentTime += clock.getElapsedTime();
+	}
+
+	auto perResponse = [&](sf::Time time)
+	{
+		return time.asMicroseconds() / double(rounds);
+	};
+
+	std::cout << json.size() << " bytes, " << handlerResult.entries.size() << " entries, " << rounds << " rounds"
+		<< std::endl;
+	std::cout << "Handler:  " << perResponse(handlerTime) << " us per response" << std::endl;
+	std::cout << "Document: " << perResponse(documentTime) << " us per response" << std::endl;
+	std::cout << (same ? "Results match" : "Results differ") << std::endl;
+	return same ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
 	std::vector<std::string> args(argv, argv + argc);
 
+	if (args.size() > 1 && args[1] == "--convert-geoip")
+	{
+		return convertGeoIPTable(args);
+	}
+
+	if (args.size() > 1 && args[1] == "--benchmark-replays")
+	{
+		return benchmarkReplayParser(args);
+	}
+
+	if (args.size() > 1 && args[1] == "--benchmark-leaderboard")
+	{
+		return benchmarkLeaderboardParser(args);
+	}
+
 	WOSApplication client;
 	return client.run(args);
 }
@@ -3,14 +3,28 @@
 #include <Shared/Utils/DebugLog.hpp>
 #include <Shared/Utils/Filesystem/DirectoryObserver.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
-#include <Shared/Utils/Utilities.hpp>
 #include <cstddef>
 #include <utility>
 
+static const std::string localPlayerKey = "Succesfuly Received Steam user stats  ";
+static const std::string matchmakingChangeKey = "changed:  Match  ";
+static const std::string matchmakingJoinSuffix = "  joining  to  joined";
+static const std::string matchmakingLeaveSuffix = "  to  idle";
+
 NetworkLogReader::NetworkLogReader()
 {
 	callbackStart = []{};
 	callbackEnd = []{};
+
+	addLineHandler(localPlayerKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseLocalPlayer(line, keyPos);
+	});
+
+	addLineHandler(matchmakingChangeKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseSessionChange(line, withCallback);
+	});
 }
 
 NetworkLogReader::~NetworkLogReader()
@@ -32,18 +46,19 @@ sf::Uint64 NetworkLogReader::getLocalSteamID() const
 	return localSteamID;
 }
 
-void NetworkLogReader::onProcessLine(const std::string & line, bool withCallback)
+void NetworkLogReader::parseLocalPlayer(StringView line, std::size_t keyPos)
 {
-	parseLocalPlayer(line, [=](sf::Uint64 steamID)
+	sf::Uint64 steamID = cStoUL(line.substr(keyPos + localPlayerKey.size()).toString());
+	if (steamID != 0 && localSteamID == 0)
 	{
-		if (localSteamID == 0)
-		{
-			debug() << "Found local SteamID: " << steamID;
-			localSteamID = steamID;
-		}
-	});
+		debug() << "Found local SteamID: " << steamID;
+		localSteamID = steamID;
+	}
+}
 
-	parseSessionStart(line, [=]
+void NetworkLogReader::parseSessionChange(StringView line, bool withCallback)
+{
+	if (line.endsWith(matchmakingJoinSuffix))
 	{
 		playing = true;
 		debug() << "Game session started.";
@@ -51,9 +66,8 @@ void NetworkLogReader::onProcessLine(const std::string & line, bool withCallback
 		{
 			callbackStart();
 		}
-	});
-
-	parseSessionEnd(line, [=]
+	}
+	else if (line.endsWith(matchmakingLeaveSuffix))
 	{
 		playing = false;
 		debug() << "Game session ended.";
@@ -61,43 +75,6 @@ void NetworkLogReader::onProcessLine(const std::string & line, bool withCallback
 		{
 			callbackEnd();
 		}
-	});
-}
-
-void NetworkLogReader::parseLocalPlayer(const std::string& line, std::function<void(sf::Uint64)> callback)
-{
-	static const std::string playerJoinKey = "Succesfuly Received Steam user stats  ";
-
-	std::size_t found = line.find(playerJoinKey);
-	if (found != std::string::npos)
-	{
-		sf::Uint64 steamID = cStoUL(line.substr(found + playerJoinKey.size()));
-		if (steamID != 0)
-		{
-			callback(steamID);
-		}
-	}
-}
-
-void NetworkLogReader::parseSessionStart(const std::string & line, CallbackVoid callback)
-{
-	static const std::string newMatchmakingJoinKey = "changed:  Match  ";
-	static const std::string newMatchmakingJoinSuffix = "  joining  to  joined";
-
-	if (stringEndsWith(line, newMatchmakingJoinSuffix) && line.find(newMatchmakingJoinKey) != std::string::npos)
-	{
-		callback();
-	}
-}
-
-void NetworkLogReader::parseSessionEnd(const std::string & line, CallbackVoid callback)
-{
-	static const std::string newMatchmakingLeaveKey = "changed:  Match  ";
-	static const std::string newMatchmakingLeaveSuffix = "  to  idle";
-
-	if (stringEndsWith(line, newMatchmakingLeaveSuffix) && line.find(newMatchmakingLeaveKey) != std::string::npos)
-	{
-		callback();
 	}
 }
 
@@ -5,6 +5,7 @@
 #include <Client/RankCheck/PlayerData.hpp>
 #include <SFML/Config.hpp>
 #include <SFML/Network/IpAddress.hpp>
+#include <cstddef>
 #include <functional>
 #include <map>
 #include <set>
@@ -39,12 +40,10 @@ private:
 
 	virtual void onReopenFile() override;
 	virtual void onReopenFileSuccess() override;
-	virtual void onProcessLine(const std::string & line, bool withCallback) override;
 	virtual std::vector<std::string> getFileNameList() const override;
 
-	static void parseLocalPlayer(const std::string & line, std::function<void(sf::Uint64)> callback);
-	static void parseSessionStart(const std::string & line, CallbackVoid callback);
-	static void parseSessionEnd(const std::string & line, CallbackVoid callback);
+	void parseLocalPlayer(StringView line, std::size_t keyPos);
+	void parseSessionChange(StringView line, bool withCallback);
 
 	CallbackVoid callbackStart;
 	CallbackVoid callbackEnd;
@@ -0,0 +1,143 @@
+#include <Client/RankCheck/PersistentLogIndex.hpp>
+#include <Poco/Path.h>
+#include <Shared/Utils/DataStream.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <algorithm>
+
+constexpr std::size_t PersistentLogIndex::MAX_HEAD_SIZE;
+
+static constexpr sf::Int32 HEADER = 1333338;
+static constexpr sf::Int16 VERSION = 0;
+
+PersistentLogIndex::PersistentLogIndex()
+{
+	Poco::Path dir(Poco::Path::dataHome());
+	dir.pushDirectory("rankcheck");
+	INDEX_FILENAME = Poco::Path(dir, "persistentlog.idx").toString();
+}
+
+PersistentLogIndex::~PersistentLogIndex()
+{
+}
+
+bool PersistentLogIndex::load()
+{
+	reset(0, 0, 0);
+
+	DataStream stream;
+	if (!stream.openInFile(INDEX_FILENAME))
+	{
+		return false;
+	}
+
+	sf::Int32 header;
+	sf::Int16 version;
+	stream >> header >> version;
+
+	if (!stream.isValid() || header != HEADER || version != VERSION)
+	{
+		debug() << "Ignoring unrecognized persistent log index " << INDEX_FILENAME;
+		return false;
+	}
+
+	stream >> headHash >> headSize >> baseOffset >> indexedEnd >> matchStarts >> ratingUploads;
+
+	if (!stream.isValid() || baseOffset > indexedEnd)
+	{
+		debug() << "Ignoring corrupt persistent log index " << INDEX_FILENAME;
+		reset(0, 0, 0);
+		return false;
+	}
+
+	return true;
+}
+
+bool PersistentLogIndex::save() const
+{
+	DataStream stream;
+	if (!stream.openOutFile(INDEX_FILENAME))
+	{
+		debug() << "Failed to write persistent log index " << INDEX_FILENAME;
+		return false;
+	}
+
+	stream << HEADER << VERSION << headHash << headSize << baseOffset << indexedEnd << matchStarts << ratingUploads;
+	return true;
+}
+
+void PersistentLogIndex::reset(sf::Uint64 headHash, sf::Uint32 headSize, sf::Uint64 offset)
+{
+	this->headHash = headHash;
+	this->headSize = headSize;
+	baseOffset = offset;
+	indexedEnd = offset;
+	matchStarts.clear();
+	ratingUploads.clear();
+}
+
+bool PersistentLogIndex::matchesFile(sf::Uint64 headHash, sf::Uint64 fileSize) const
+{
+	return headSize != 0 && this->headHash == headHash && fileSize >= indexedEnd;
+}
+
+sf::Uint32 PersistentLogIndex::getHeadSize() const
+{
+	return headSize;
+}
+
+sf::Uint64 PersistentLogIndex::getBaseOffset() const
+{
+	return baseOffset;
+}
+
+sf::Uint64 PersistentLogIndex::getIndexedEnd() const
+{
+	return indexedEnd;
+}
+
+void PersistentLogIndex::extend(sf::Uint64 offset)
+{
+	indexedEnd = std::max(indexedEnd, offset);
+}
+
+void PersistentLogIndex::addMatchStart(sf::Uint64 offset)
+{
+	if (isNewEntry(offset, matchStarts.empty() ? 0 : matchStarts.back(), matchStarts.empty()))
+	{
+		matchStarts.push_back(offset);
+	}
+}
+
+void PersistentLogIndex::addRatingUpload(sf::Uint64 offset, sf::Int64 rating)
+{
+	if (isNewEntry(offset, ratingUploads.empty() ? 0 : ratingUploads.back().first, ratingUploads.empty()))
+	{
+		ratingUploads.emplace_back(offset, rating);
+	}
+}
+
+bool PersistentLogIndex::hasMatchStart() const
+{
+	return !matchStarts.empty();
+}
+
+sf::Uint64 PersistentLogIndex::getLatestMatchStart() const
+{
+	return matchStarts.empty() ? baseOffset : matchStarts.back();
+}
+
+const std::vector<sf::Uint64>& PersistentLogIndex::getMatchStarts() const
+{
+	return matchStarts;
+}
+
+const std::vector<PersistentLogIndex::RatingUpload>& PersistentLogIndex::getRatingUploads() const
+{
+	return ratingUploads;
+}
+
+bool PersistentLogIndex::isNewEntry(sf::Uint64 offset, sf::Uint64 lastOffset, bool empty) const
+{
+	// Entries are kept sorted; lines before the end of the indexed range have been recorded already.
+	return offset >= indexedEnd && (empty || offset > lastOffset);
+}
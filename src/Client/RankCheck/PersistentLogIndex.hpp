@@ -0,0 +1,86 @@
+#ifndef SRC_CLIENT_RANKCHECK_PERSISTENTLOGINDEX_HPP_
+#define SRC_CLIENT_RANKCHECK_PERSISTENTLOGINDEX_HPP_
+
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Sidecar index for "ApplicationPersistent.log", stored in RankCheck's data directory.
+ *
+ * Records the file offsets of match starts and rating uploads within a contiguous range of the log file, starting at
+ * the base offset and ending after the last indexed line. The range is extended as new lines are appended to the log.
+ *
+ * The index is tied to a log file by a hash of the file's first bytes. It no longer applies if the head of the file
+ * changes or the file becomes smaller than the indexed range.
+ */
+class PersistentLogIndex
+{
+public:
+
+	/**
+	 * Offset of a rating upload line, and the uploaded rating (multiplied by 10).
+	 */
+	using RatingUpload = std::pair<sf::Uint64, sf::Int64>;
+
+	/**
+	 * Maximum number of bytes at the start of the log file used to identify it.
+	 */
+	static constexpr std::size_t MAX_HEAD_SIZE = 4096;
+
+	PersistentLogIndex();
+	~PersistentLogIndex();
+
+	bool load();
+	bool save() const;
+
+	/**
+	 * Discards all entries and starts indexing the file with the specified head at the specified offset.
+	 */
+	void reset(sf::Uint64 headHash, sf::Uint32 headSize, sf::Uint64 offset);
+
+	/**
+	 * Returns true if the index applies to a file with the specified size, whose first getHeadSize() bytes have the
+	 * specified hash.
+	 */
+	bool matchesFile(sf::Uint64 headHash, sf::Uint64 fileSize) const;
+
+	sf::Uint32 getHeadSize() const;
+
+	sf::Uint64 getBaseOffset() const;
+	sf::Uint64 getIndexedEnd() const;
+
+	/**
+	 * Marks the log file as indexed up to the specified offset.
+	 */
+	void extend(sf::Uint64 offset);
+
+	/**
+	 * Adds entries for lines at or after the end of the indexed range. Lines that are already indexed are ignored.
+	 */
+	void addMatchStart(sf::Uint64 offset);
+	void addRatingUpload(sf::Uint64 offset, sf::Int64 rating);
+
+	bool hasMatchStart() const;
+	sf::Uint64 getLatestMatchStart() const;
+
+	const std::vector<sf::Uint64> & getMatchStarts() const;
+	const std::vector<RatingUpload> & getRatingUploads() const;
+
+private:
+
+	bool isNewEntry(sf::Uint64 offset, sf::Uint64 lastOffset, bool empty) const;
+
+	std::string INDEX_FILENAME;
+
+	sf::Uint64 headHash = 0;
+	sf::Uint32 headSize = 0;
+	sf::Uint64 baseOffset = 0;
+	sf::Uint64 indexedEnd = 0;
+	std::vector<sf::Uint64> matchStarts;
+	std::vector<RatingUpload> ratingUploads;
+};
+
+#endif
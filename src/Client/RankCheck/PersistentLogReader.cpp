@@ -2,7 +2,9 @@
 #include <Shared/Config/CompositeTypes.hpp>
 #include <Shared/Config/Config.hpp>
 #include <Shared/Utils/DebugLog.hpp>
+#include <Shared/Utils/Hash.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
+#include <algorithm>
 #include <cmath>
 #include <utility>
 
@@ -10,12 +12,49 @@ static cfg::Int cfgMatchStartPos("rankcheck.persistentLogReader.currentOffset");
 static cfg::List<cfg::Int> cfgRatingHistory("rankcheck.ratingHistory.buffer");
 static cfg::Int cfgRatingHistoryBufferSize("rankcheck.ratingHistory.bufferSize");
 
+static const std::string ownSteamIDKey = "\tInitialised steam for appId: 204300 userId: ";
+static const std::string remotePlayerJoinKey = "\treceived onPlayerJoined, player:  ";
+static const std::string localPlayerJoinKey = "\tlocal onPlayerJoined, player:  ";
+static const std::string gameEndKey = "\tGame end request  ";
+static const std::string rankingScoreKey = "\tUploading new ranking score of  ";
+
 PersistentLogReader::PersistentLogReader()
 {
+	addLineHandler(ownSteamIDKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseOwnSteamID(line, keyPos);
+	});
+
+	addLineHandler(remotePlayerJoinKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseRemotePlayerJoin(line, withCallback);
+	});
+
+	addLineHandler(localPlayerJoinKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseLocalPlayerJoin(withCallback);
+	});
+
+	addLineHandler(gameEndKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		resetPlayers();
+	});
+
+	addLineHandler(rankingScoreKey, [=](StringView line, std::size_t keyPos, bool withCallback)
+	{
+		parseRankingScore(line, keyPos, withCallback);
+	});
+
+	index.load();
 }
 
 PersistentLogReader::~PersistentLogReader()
 {
+	if (indexing)
+	{
+		index.extend(tell());
+		index.save();
+	}
 }
 
 void PersistentLogReader::markMatchStart()
@@ -59,112 +98,108 @@ void PersistentLogReader::onReopenFileSuccess()
 	}
 }
 
-void PersistentLogReader::onProcessLine(const std::string& line, bool withCallback)
+void PersistentLogReader::parseOwnSteamID(StringView line, std::size_t keyPos)
 {
-	static const std::string ownSteamIDKey = "\tInitialised steam for appId: 204300 userId: ";
-	static const std::string remotePlayerJoinKey = "\treceived onPlayerJoined, player:  ";
-	static const std::string localPlayerJoinKey = "\tlocal onPlayerJoined, player:  ";
-	static const std::string gameEndKey = "\tGame end request  ";
-	static const std::string rankingScoreKey = "\tUploading new ranking score of  ";
-
-	std::size_t found = 0;
-
-	found = line.find(ownSteamIDKey);
-	if (found != std::string::npos)
+	std::size_t foundSpace = line.find_first_of(' ', keyPos);
+	if (foundSpace != StringView::npos)
 	{
-		std::size_t foundSpace = line.find_first_of(' ', found);
-		if (foundSpace != std::string::npos)
+		sf::Uint64 steamID = cStoUL(line.substr(keyPos, foundSpace - keyPos).toString());
+		if (localSteamID != steamID)
 		{
-			sf::Uint64 steamID = cStoUL(line.substr(found, foundSpace - found));
-			if (localSteamID != steamID)
-			{
-				// TODO: handle rating history properly when switching accounts (per-account history buffer).
-				localSteamID = steamID;
-			}
+			// TODO: handle rating history properly when switching accounts (per-account history buffer).
+			localSteamID = steamID;
 		}
 	}
+}
 
-	found = line.find(remotePlayerJoinKey);
-	if (found != std::string::npos)
+void PersistentLogReader::parseRemotePlayerJoin(StringView line, bool withCallback)
+{
+	std::size_t foundHash = line.find_last_of('#');
+	if (foundHash != StringView::npos)
 	{
-		std::size_t foundHash = line.find_last_of('#');
-		if (foundHash != std::string::npos)
+		if (currentPlayers.empty())
 		{
-			if (currentPlayers.empty())
+			if (indexing)
 			{
-				currentPlayers.insert(localSteamID);
-				if (withCallback)
-				{
-					playerCallback(localSteamID);
-					debug() << "Emitting local player " << localSteamID;
-				}
+				index.addMatchStart(tellLineStart());
 			}
 
-			sf::Uint64 steamID = cStoUL(line.substr(foundHash + 1));
-			if (steamID != 0 && currentPlayers.count(steamID) == 0)
-			{
-				currentPlayers.insert(steamID);
-				foundMatch = true;
-				if (withCallback)
-				{
-					playerCallback(steamID);
-					debug() << "Found player " << steamID;
-				}
-			}
-			else
+			currentPlayers.insert(localSteamID);
+			if (withCallback)
 			{
-				//debug() << "Ignoring player " << steamID;
+				playerCallback(localSteamID);
+				debug() << "Emitting local player " << localSteamID;
 			}
 		}
-	}
 
-	if (line.find(localPlayerJoinKey) != std::string::npos)
-	{
-		foundMatch = true;
-		expectRating = true;
-		if (currentPlayers.empty())
+		sf::Uint64 steamID = cStoUL(line.substr(foundHash + 1).toString());
+		if (steamID != 0 && currentPlayers.count(steamID) == 0)
 		{
-			currentPlayers.insert(localSteamID);
+			currentPlayers.insert(steamID);
+			foundMatch = true;
 			if (withCallback)
 			{
-				playerCallback(localSteamID);
-				debug() << "Emitting local player " << localSteamID;
+				playerCallback(steamID);
+				debug() << "Found player " << steamID;
 			}
 		}
+		else
+		{
+			//debug() << "Ignoring player " << steamID;
+		}
 	}
+}
 
-	if (line.find(gameEndKey) != std::string::npos)
+void PersistentLogReader::parseLocalPlayerJoin(bool withCallback)
+{
+	foundMatch = true;
+	expectRating = true;
+	if (currentPlayers.empty())
 	{
-		resetPlayers();
+		if (indexing)
+		{
+			index.addMatchStart(tellLineStart());
+		}
+
+		currentPlayers.insert(localSteamID);
+		if (withCallback)
+		{
+			playerCallback(localSteamID);
+			debug() << "Emitting local player " << localSteamID;
+		}
 	}
+}
 
-	found = line.find(rankingScoreKey);
-	if (found != std::string::npos)
-	{
-		double rating = cStoD(line.substr(found + rankingScoreKey.size()));
+void PersistentLogReader::parseRankingScore(StringView line, std::size_t keyPos, bool withCallback)
+{
+	double rating = cStoD(line.substr(keyPos + rankingScoreKey.size()).toString());
 
-		if (expectRating)
-		{
-			debug() << "Found rating " << rating;
-			expectRating = false;
+	if (expectRating)
+	{
+		debug() << "Found rating " << rating;
+		expectRating = false;
 
-			ratingHistory.push_back(std::floor(rating * 10.0 + 0.5));
+		ratingHistory.push_back(std::floor(rating * 10.0 + 0.5));
 
-			if (withCallback && ratingHistory.size() > 1)
-			{
-				ratingCallback(ratingHistory.back() - ratingHistory[ratingHistory.size() - 2]);
-			}
+		if (indexing)
+		{
+			index.addRatingUpload(tellLineStart(), ratingHistory.back());
+		}
 
-			while (ratingHistory.size() > ratingHistoryLimit)
-			{
-				ratingHistory.erase(ratingHistory.begin());
-			}
+		if (withCallback && ratingHistory.size() > 1)
+		{
+			ratingCallback(ratingHistory.back() - ratingHistory[ratingHistory.size() - 2]);
 		}
-		else
+
+		while (ratingHistory.size() > ratingHistoryLimit)
 		{
-			debug() << "Found rating " << rating << " outside of match, skipping";
+			ratingHistory.erase(ratingHistory.begin());
 		}
 	}
+	else
+	{
+		debug() << "Found rating " << rating << " outside of match, skipping";
+	}
 }
 
 std::vector<std::string> PersistentLogReader::getFileNameList() const
@@ -174,37 +209,25 @@ std::vector<std::string> PersistentLogReader::getFileNameList() const
 
 bool PersistentLogReader::onInitRead()
 {
-	if (matchStartPos == 0)
+	indexing = false;
+
+	if (tryReadFromIndex())
 	{
-		debug() << "No last match start known; searching...";
-		bool success = false;
-		for (std::size_t i = 1; i < 100; ++i)
+		return true;
+	}
+	else if (matchStartPos == 0)
+	{
+		debug() << "No last match start known; searching backwards...";
+		std::size_t searchPos = 0;
+		if (findLatestMatchBoundary(searchPos) && seek(searchPos) && tryFindLatestMatch())
 		{
-			if (seekFromEnd(i * 1000000))
-			{
-				debug() << "Trying offset " << tell();
-				if (tryFindLatestMatch())
-				{
-					debug() << "Found latest match around " << matchStartPos;
-					success = true;
-					break;
-				}
-			}
-			else
-			{
-				debug() << "Seek failed";
-				break;
-			}
+			debug() << "Found latest match around " << matchStartPos;
 		}
-
-		if (!success)
+		else
 		{
-			seek(0);
-			debug() << "Searching from beginning...";
-			if (!tryFindLatestMatch())
-			{
-				debug() << "No matches found in persistent log.";
-			}
+			debug() << "No matches found in persistent log.";
+			seekFromEnd(0);
+			resetIndex(tell());
 		}
 		requestingStateSave = true;
 		return false;
@@ -213,10 +236,112 @@ bool PersistentLogReader::onInitRead()
 	{
 		debug() << "Skipping to last known match start at " << matchStartPos;
 		skipToMatchStart();
+		resetIndex(tell());
 		return true;
 	}
 }
 
+bool PersistentLogReader::findLatestMatchBoundary(std::size_t & boundary)
+{
+	bool foundPlayerJoin = false;
+	bool foundBoundary = false;
+	std::size_t laterLineStart = 0;
+
+	bool success = readLinesBackwards([&](StringView line, std::size_t lineStart)
+	{
+		if (!foundPlayerJoin)
+		{
+			foundPlayerJoin = line.find(remotePlayerJoinKey) != StringView::npos
+				|| line.find(localPlayerJoinKey) != StringView::npos;
+		}
+		else if (line.find(gameEndKey) != StringView::npos || line.find(rankingScoreKey) != StringView::npos)
+		{
+			// The latest match begins after the previous match's end or rating upload.
+			boundary = laterLineStart;
+			foundBoundary = true;
+			return false;
+		}
+
+		laterLineStart = lineStart;
+		return true;
+	});
+
+	if (success && foundPlayerJoin && !foundBoundary)
+	{
+		// The latest match is the first one in the file.
+		boundary = 0;
+	}
+
+	return success && foundPlayerJoin;
+}
+
+bool PersistentLogReader::tryReadFromIndex()
+{
+	std::size_t fileSize = getFileSize();
+
+	if (index.getHeadSize() == 0 || index.getHeadSize() > fileSize
+		|| !index.matchesFile(hashFileHead(index.getHeadSize()), fileSize))
+	{
+		debug() << "No persistent log index available for this file";
+		return false;
+	}
+
+	if (matchStartPos > index.getIndexedEnd())
+	{
+		debug() << "Persistent log index is older than the last known match start";
+		return false;
+	}
+
+	// Continue reading from the latest indexed match, unless the saved match start is more recent.
+	std::size_t startPos = std::max<sf::Uint64>(index.getLatestMatchStart(), matchStartPos);
+
+	// Without a saved position, the saved rating history cannot be matched up with the file, so it is rebuilt from the
+	// index. Otherwise, only rating uploads after the saved position are appended.
+	if (matchStartPos == 0)
+	{
+		ratingHistory.clear();
+	}
+
+	for (const auto & upload : index.getRatingUploads())
+	{
+		if (upload.first >= matchStartPos && upload.first < startPos)
+		{
+			ratingHistory.push_back(upload.second);
+		}
+	}
+
+	while (ratingHistory.size() > ratingHistoryLimit)
+	{
+		ratingHistory.erase(ratingHistory.begin());
+	}
+
+	debug() << "Skipping to indexed match start at " << startPos;
+
+	if (!seek(startPos))
+	{
+		debug() << "Failed to seek to indexed match start!";
+		return false;
+	}
+
+	matchStartPos = startPos;
+	foundMatch = index.hasMatchStart();
+	indexing = true;
+	return true;
+}
+
+void PersistentLogReader::resetIndex(std::size_t offset)
+{
+	std::size_t headSize = std::min(getFileSize(), PersistentLogIndex::MAX_HEAD_SIZE);
+	index.reset(hashFileHead(headSize), headSize, offset);
+	indexing = true;
+}
+
+sf::Uint64 PersistentLogReader::hashFileHead(std::size_t size)
+{
+	std::string head = peek(0, size);
+	return head.size() == size ? dataHash64(head.data(), head.size()) : 0;
+}
+
 void PersistentLogReader::setPlayerCallback(PersistentLogReader::Callback callback)
 {
 	playerCallback = callback;
@@ -244,10 +369,16 @@ void PersistentLogReader::onInitConfig(const cfg::Config& config)
 	}
 }
 
-void PersistentLogReader::saveState(cfg::Config& config) const
+void PersistentLogReader::saveState(cfg::Config& config)
 {
 	config.set(cfgMatchStartPos, matchStartPos);
 	config.set(cfgRatingHistory, ratingHistory);
+
+	if (indexing)
+	{
+		index.extend(tell());
+		index.save();
+	}
 }
 
 void PersistentLogReader::resetPlayers()
@@ -273,6 +404,7 @@ bool PersistentLogReader::tryFindLatestMatch()
 	resetPlayers();
 	ratingHistory.clear();
 	std::size_t pos = tell();
+	resetIndex(pos);
 	if (readInitial() && foundMatch)
 	{
 		matchStartPos = pos;
@@ -2,6 +2,7 @@
 #define SRC_CLIENT_RANKCHECK_PERSISTENTLOGREADER_HPP_
 
 #include <Client/RankCheck/LogReader.hpp>
+#include <Client/RankCheck/PersistentLogIndex.hpp>
 #include <SFML/Config.hpp>
 #include <cstddef>
 #include <functional>
@@ -15,7 +16,8 @@
  * Detects SteamIDs of players in the match and local rating changes.
  *
  * To avoid parsing the entire file everytime RankCheck starts, the file read position of the current match is saved in
- * RankCheck's config file.
+ * RankCheck's config file. In addition, the offsets of all match starts and rating uploads are recorded in a sidecar
+ * index (see PersistentLogIndex), which allows skipping straight to the latest match even without a saved position.
  */
 class PersistentLogReader : public LogReader
 {
@@ -32,7 +34,7 @@ public:
 	void markMatchStart();
 	void skipToMatchStart();
 
-	void saveState(cfg::Config & config) const;
+	void saveState(cfg::Config & config);
 
 	void setPlayerCallback(Callback callback);
 	Callback getPlayerCallback() const;
@@ -53,11 +55,20 @@ private:
 
 	virtual void onReopenFile() override;
 	virtual void onReopenFileSuccess() override;
-	virtual void onProcessLine(const std::string & line, bool withCallback) override;
 	virtual std::vector<std::string> getFileNameList() const override;
 	virtual bool onInitRead() override;
 	virtual void onInitConfig(const cfg::Config & config) override;
 
+	void parseOwnSteamID(StringView line, std::size_t keyPos);
+	void parseRemotePlayerJoin(StringView line, bool withCallback);
+	void parseLocalPlayerJoin(bool withCallback);
+	void parseRankingScore(StringView line, std::size_t keyPos, bool withCallback);
+
+	bool findLatestMatchBoundary(std::size_t & boundary);
+	bool tryReadFromIndex();
+	void resetIndex(std::size_t offset);
+	sf::Uint64 hashFileHead(std::size_t size);
+
 	bool tryFindLatestMatch();
 	void emitCurrentData();
 
@@ -72,6 +83,8 @@ private:
 	Callback playerCallback;
 	RatingCallback ratingCallback;
 	std::size_t ratingHistoryLimit;
+	PersistentLogIndex index;
+	bool indexing = false;
 };
 
 #endif
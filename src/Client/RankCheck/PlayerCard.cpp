@@ -340,11 +340,11 @@ void PlayerCard::initWithConfig(const cfg::Config& config)
 			LineSetting line;
 			std::string lineKey = displayModeKey + ".lines[" + cNtoS(j) + "]";
 
-			line.text = config.get(cfg::String(lineKey + ".text"));
+			line.text = PlayerData::Template(config.get(cfg::String(lineKey + ".text")));
 			line.size = config.get(cfg::Int(lineKey + ".size"));
 			line.color = config.get(cfg::Color(lineKey + ".color"));
 			line.offset = config.get(cfg::Vector2f(lineKey + ".offset"));
-			line.condition = config.get(cfg::String(lineKey + ".condition"));
+			line.condition = PlayerData::Condition(config.get(cfg::String(lineKey + ".condition")));
 			line.alignRight = config.get(cfg::Bool(lineKey + ".alignRight"));
 
 			displayMode.lines.push_back(line);
@@ -366,7 +366,7 @@ void PlayerCard::initWithConfig(const cfg::Config& config)
 			icon.position = config.get(cfg::Vector2f(iconKey + ".position"));
 			icon.size = config.get(cfg::Vector2f(iconKey + ".size"));
 			icon.borderThickness = config.get(cfg::Float(iconKey + ".borderThickness"));
-			icon.condition = config.get(cfg::String(iconKey + ".condition"));
+			icon.condition = PlayerData::Condition(config.get(cfg::String(iconKey + ".condition")));
 
 			displayMode.icons.push_back(icon);
 		}
@@ -469,10 +469,11 @@ void PlayerCard::updatePlayer()
 		addMode();
 		for (const LineSetting & line : mode.lines)
 		{
-			if (data.evaluate(line.condition))
+			if (line.condition.test(data))
 			{
 				addGap(line.offset.y);
-				addLine(data.format(line.text), line.size, line.offset.x, line.color, line.alignRight);
+				line.text.render(data, lineBuffer);
+				addLine(lineBuffer, line.size, line.offset.x, line.color, line.alignRight);
 			}
 		}
 
@@ -481,7 +482,7 @@ void PlayerCard::updatePlayer()
 		std::vector<Icon> iconList;
 		for (const IconSetting & iconSetting : mode.icons)
 		{
-			if (!data.evaluate(iconSetting.condition))
+			if (!iconSetting.condition.test(data))
 			{
 				continue;
 			}
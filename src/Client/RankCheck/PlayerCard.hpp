@@ -81,11 +81,11 @@ private:
 
 	struct LineSetting
 	{
-		std::string text;
+		PlayerData::Template text;
 		unsigned int size;
 		sf::Color color;
 		sf::Vector2f offset;
-		std::string condition;
+		PlayerData::Condition condition;
 		bool alignRight;
 	};
 
@@ -103,7 +103,7 @@ private:
 		sf::Vector2f position;
 		sf::Vector2f size;
 		float borderThickness;
-		std::string condition;
+		PlayerData::Condition condition;
 	};
 
 	struct DisplaySetting
@@ -152,6 +152,9 @@ private:
 	mutable std::vector<std::vector<sf::Text>> lines;
 	mutable std::vector<std::vector<Icon>> icons;
 
+	// Reused between lines to avoid allocating the text of every line.
+	std::string lineBuffer;
+
 	float curLineYPos;
 
 	int slot;
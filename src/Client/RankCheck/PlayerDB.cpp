@@ -1,48 +1,66 @@
 #include <Client/RankCheck/PlayerDB.hpp>
+#include <Poco/File.h>
 #include <Poco/Path.h>
 #include <Shared/Utils/DataStream.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <Shared/Utils/Endian.hpp>
 #include <Shared/Utils/Error.hpp>
+#include <Shared/Utils/Filesystem/MappedFile.hpp>
+#include <Shared/Utils/MakeUnique.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
 #include <utility>
 
 std::string PlayerDB::EntryV0::getCommonName() const
 {
-	std::string commonName;
-	sf::Uint32 commonCount = 0;
-	for (const auto & name : names)
-	{
-		if (commonCount < name.second)
-		{
-			commonName = name.first;
-			commonCount = name.second;
-		}
-	}
 	return commonName;
 }
 
-void PlayerDB::EntryV0::addName(const std::string& name)
+void PlayerDB::EntryV0::addName(const std::string& name, sf::Uint32 count)
 {
 	if (name == "[unknown]" || name.empty())
 	{
 		return;
 	}
 
-	if (names.count(name) == 0)
+	sf::Uint32 & nameCount = names[name];
+	nameCount += count;
+
+	// Counts only ever increase, so comparing against the previous most common name is sufficient.
+	if (nameCount > commonNameCount || (nameCount == commonNameCount && name < commonName))
 	{
-		names[name] = 1;
+		commonName = name;
+		commonNameCount = nameCount;
 	}
-	else
+}
+
+void PlayerDB::EntryV0::updateCommonName()
+{
+	commonName.clear();
+	commonNameCount = 0;
+	for (const auto & name : names)
 	{
-		names[name]++;
+		if (commonNameCount < name.second)
+		{
+			commonName = name.first;
+			commonNameCount = name.second;
+		}
 	}
 }
 
-PlayerDB::PlayerDB()
+PlayerDB::PlayerDB() :
+	overlay(std::make_shared<Overlay>())
 {
 	Poco::Path dir(Poco::Path::dataHome());
 	dir.pushDirectory("rankcheck");
 	DB_FILENAME = Poco::Path(dir, "players.db").toString();
+	JOURNAL_FILENAME = Poco::Path(dir, "players.journal").toString();
 }
 
 PlayerDB::~PlayerDB()
@@ -50,86 +68,925 @@ PlayerDB::~PlayerDB()
 }
 
 static constexpr sf::Int32 HEADER = 1333337;
+static constexpr sf::Int16 VERSION = 4;
+
+// Version 4 file layout (little-endian):
+// - Header: header magic (4), version (2), entry count (4), replay hash count (4), generation (4), size of the previous
+//   generation's journal (8). Version 3 headers end after the replay hash count.
+// - Entries, sorted by SteamID: SteamID (8), sponsor SteamID (8), ally count (4), enemy count (4), blob offset (4).
+// - Replay hashes, sorted: 5 words (4) each.
+// - Blob: per entry, name count (2) followed by count (4), length (2) and characters of each name, then IP count (1)
+//   followed by each IP address (4).
+static constexpr std::size_t V3_HEADER_SIZE = 14;
+static constexpr std::size_t V4_HEADER_SIZE = 26;
+static constexpr std::size_t V3_ENTRY_SIZE = 28;
+static constexpr std::size_t V3_HASH_SIZE = 20;
+
+// Journal layout (little-endian): header magic (4), version (2), generation (4), followed by records, each starting with
+// a record type (1):
+// - Player added to stats: SteamID (8), relation (1), sponsor SteamID (8), name length (2), name.
+// - IP mapping: SteamID (8), IP address (4).
+// - Replay hash: 5 words (4).
+static constexpr sf::Int32 JOURNAL_HEADER = 1333340;
+static constexpr sf::Int16 JOURNAL_VERSION = 0;
+static constexpr std::size_t JOURNAL_HEADER_SIZE = 10;
+
+enum JournalRecordType
+{
+	JournalPlayer = 1,
+	JournalIPMapping = 2,
+	JournalReplayHash = 3
+};
+
+static sf::Uint16 readUint16(const char * data)
+{
+	sf::Uint16 value;
+	std::memcpy(&value, data, sizeof(value));
+	return n2hs(value);
+}
+
+static sf::Uint32 readUint32(const char * data)
+{
+	sf::Uint32 value;
+	std::memcpy(&value, data, sizeof(value));
+	return n2hl(value);
+}
+
+static sf::Uint64 readUint64(const char * data)
+{
+	sf::Uint64 value;
+	std::memcpy(&value, data, sizeof(value));
+	return n2hll(value);
+}
+
+static void writeUint16(std::vector<char> & data, sf::Uint16 value)
+{
+	value = h2ns(value);
+	data.insert(data.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value + 1));
+}
+
+static void writeUint32(std::vector<char> & data, sf::Uint32 value)
+{
+	value = h2nl(value);
+	data.insert(data.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value + 1));
+}
+
+static void writeUint64(std::vector<char> & data, sf::Uint64 value)
+{
+	value = h2nll(value);
+	data.insert(data.end(), reinterpret_cast<const char *>(&value), reinterpret_cast<const char *>(&value + 1));
+}
+
+static void writeHash(std::vector<char> & data, const ReplayParser::ReplayInfo::Hash & hash)
+{
+	for (auto word : hash.data)
+	{
+		writeUint32(data, word);
+	}
+}
+
+static void writeJournalHeader(std::vector<char> & data, sf::Uint32 generation)
+{
+	writeUint32(data, JOURNAL_HEADER);
+	writeUint16(data, JOURNAL_VERSION);
+	writeUint32(data, generation);
+}
+
+static bool readFile(const std::string & filename, std::vector<char> & data)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+static void createParentDirectory(const std::string & filename)
+{
+	try
+	{
+		Poco::File(Poco::Path(filename).setFileName("")).createDirectories();
+	}
+	catch (std::exception & ex)
+	{
+		throw Error("Error saving player database: could not create directory for " + filename);
+	}
+}
+
+static void writeFile(const std::string & filename, const std::vector<char> & data)
+{
+	createParentDirectory(filename);
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.write(data.data(), data.size()) || !file.flush())
+	{
+		throw Error("Error saving player database: could not write " + filename);
+	}
+}
+
+static void replaceFile(const std::string & source, const std::string & target)
+{
+	try
+	{
+		Poco::File(source).renameTo(target);
+	}
+	catch (std::exception & ex)
+	{
+		throw Error("Error saving player database: could not replace " + target + ": " + ex.what());
+	}
+}
+
+static ReplayParser::ReplayInfo::Hash readHash(const char * data)
+{
+	ReplayParser::ReplayInfo::Hash hash;
+	for (std::size_t i = 0; i < hash.data.size(); ++i)
+	{
+		hash.data[i] = readUint32(data + i * 4);
+	}
+	return hash;
+}
+
+PlayerDB::PlayerDB(PlayerDB && other)
+{
+	*this = std::move(other);
+}
+
+PlayerDB & PlayerDB::operator=(PlayerDB && other)
+{
+	if (this != &other)
+	{
+		DB_FILENAME = other.DB_FILENAME;
+		JOURNAL_FILENAME = other.JOURNAL_FILENAME;
+		baseOwner = std::move(other.baseOwner);
+		baseEntries = other.baseEntries;
+		baseHashes = other.baseHashes;
+		baseBlob = other.baseBlob;
+		baseEntryCount = other.baseEntryCount;
+		baseHashCount = other.baseHashCount;
+		baseBlobSize = other.baseBlobSize;
+		baseGeneration = other.baseGeneration;
+		basePreviousJournalSize = other.basePreviousJournalSize;
+		baseCleared = other.baseCleared;
+		overlay = std::move(other.overlay);
+		ipIndex = std::move(other.ipIndex);
+		legacyFormat = other.legacyFormat;
+		journaling = other.journaling;
+		journalBuffer = std::move(other.journalBuffer);
+		journalSize = other.journalSize;
+
+		other.resetBase();
+		other.overlay = std::make_shared<Overlay>();
+		other.ipIndex.reset();
+		other.legacyFormat = false;
+		other.journaling = false;
+		other.journalBuffer.clear();
+		other.journalSize = 0;
+	}
+	return *this;
+}
 
 void PlayerDB::load()
 {
-	clear();
+	resetBase();
+	overlay = std::make_shared<Overlay>();
+	ipIndex.reset();
+	legacyFormat = false;
+	journalBuffer.clear();
+	journalSize = 0;
+
+	auto file = std::make_shared<fs::MappedFile>();
+	if (file->open(DB_FILENAME) && file->getSize() >= V3_HEADER_SIZE
+		&& sf::Int32(readUint32(file->getData())) == HEADER && sf::Int16(readUint16(file->getData() + 4)) >= 3
+		&& sf::Int16(readUint16(file->getData() + 4)) <= VERSION)
+	{
+		setBase(file, file->getData(), file->getSize());
+	}
+	else
+	{
+		file.reset();
+
+		sf::Int32 header;
+		sf::Int16 version;
+
+		DataStream stream;
+		if (stream.openInFile(DB_FILENAME))
+		{
+			stream >> header >> version;
+
+			if (stream.isValid() && header == HEADER)
+			{
+				std::map<sf::Uint64, EntryV0> entriesv0;
+				std::map<sf::Uint64, EntryV2> entriesv2;
+				Overlay & changes = getMutableOverlay();
+
+				switch (version)
+				{
+				case 0:
+					stream >> entriesv0;
+					break;
+				case 1:
+					stream >> entriesv0 >> changes.replayHashes;
+					break;
+				case 2:
+					stream >> entriesv2 >> changes.replayHashes;
+					break;
+				case 3:
+				case VERSION:
+				{
+					// The file could not be mapped, so read it into memory instead.
+					auto data = std::make_shared<std::vector<char> >();
+					readFile(DB_FILENAME, *data);
+					setBase(data, data->data(), data->size());
+					break;
+				}
+				default:
+					throw Error("Error loading player database: unrecognized version " + cNtoS(version));
+				}
+
+				for (const auto & entry : entriesv0)
+				{
+					assignRecord(changes.entries.get(entry.first), entry.second);
+				}
+
+				for (const auto & entry : entriesv2)
+				{
+					assignRecord(changes.entries.get(entry.first), entry.second);
+				}
+
+				legacyFormat = (version < 3);
+			}
+			else
+			{
+				throw Error("Error loading player database: corrupt header");
+			}
+		}
+
+		// No DB? Just treat it as empty, apart from the journal.
+	}
+
+	replayJournal();
+	journaling = true;
+}
+
+void PlayerDB::save()
+{
+	sf::Uint32 generation;
+	sf::Uint64 journalFileSize;
+	readJournalState(generation, journalFileSize);
+
+	// The new file includes all changes, including those not yet written to the journal.
+	auto data = std::make_shared<std::vector<char> >(serialize(generation + 1, journalFileSize));
+
+	// The existing file may still be mapped by this or another database, so it is replaced instead of overwritten.
+	std::string tempFilename = DB_FILENAME + ".tmp";
+	writeFile(tempFilename, *data);
+
+	// Continue with the written data, which also releases this database's mapping of the old file.
+	setBase(data, data->data(), data->size());
+	overlay = std::make_shared<Overlay>();
+	legacyFormat = false;
+	journalBuffer.clear();
+
+	replaceFile(tempFilename, DB_FILENAME);
+	rotateJournal(generation + 1, journalFileSize);
+}
+
+void PlayerDB::setJournaling(bool enabled)
+{
+	journaling = enabled;
+	if (!journaling)
+	{
+		journalBuffer.clear();
+	}
+}
+
+void PlayerDB::flushJournal()
+{
+	if (journalBuffer.empty())
+	{
+		return;
+	}
+
+	sf::Uint32 generation;
+	sf::Uint64 size;
+	bool append = readJournalState(generation, size);
+
+	createParentDirectory(JOURNAL_FILENAME);
+
+	std::ofstream file(JOURNAL_FILENAME, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+	if (!append)
+	{
+		std::vector<char> header;
+		writeJournalHeader(header, baseGeneration);
+		file.write(header.data(), header.size());
+		journalSize = 0;
+	}
+
+	if (!file.write(journalBuffer.data(), journalBuffer.size()) || !file.flush())
+	{
+		throw Error("Error saving player database: could not write " + JOURNAL_FILENAME);
+	}
+
+	journalSize += journalBuffer.size();
+	journalBuffer.clear();
+}
+
+bool PlayerDB::needsCompaction(std::size_t maxJournalSize) const
+{
+	return legacyFormat || journalSize + journalBuffer.size() >= maxJournalSize;
+}
+
+std::unique_ptr<PlayerDB::Compaction> PlayerDB::startCompaction()
+{
+	flushJournal();
 
-	sf::Int32 header;
-	sf::Int16 version;
+	sf::Uint32 generation;
+	sf::Uint64 journalFileSize;
+	readJournalState(generation, journalFileSize);
 
-	DataStream stream;
-	if (!stream.openInFile(DB_FILENAME))
+	std::unique_ptr<Compaction> compaction = makeUnique<Compaction>();
+	compaction->snapshot = *this;
+	compaction->snapshot.setJournaling(false);
+	compaction->snapshot.ipIndex.reset();
+	compaction->generation = generation + 1;
+	compaction->journalOffset = journalFileSize;
+	return compaction;
+}
+
+void PlayerDB::finishCompaction(Compaction & compaction)
+{
+	if (!compaction.success)
 	{
-		// No DB? Just treat it as empty.
 		return;
 	}
 
-	stream >> header >> version;
+	// Everything in the snapshot is now part of the new base data. Entries and replay hashes added after the snapshot
+	// was taken remain in the overlay.
+	if (overlay == compaction.snapshot.overlay)
+	{
+		overlay = std::make_shared<Overlay>();
+	}
+	else
+	{
+		Overlay & changes = getMutableOverlay();
+		const Overlay & snapshotChanges = *compaction.snapshot.overlay;
+
+		changes.entries.removeIf([&](const PlayerTable::Record & record)
+		{
+			const PlayerTable::Record * snapshotRecord = snapshotChanges.entries.find(record.steamID);
+			return snapshotRecord != nullptr && *snapshotRecord == record;
+		});
+
+		for (auto it = changes.replayHashes.begin(); it != changes.replayHashes.end();)
+		{
+			if (snapshotChanges.replayHashes.count(*it))
+			{
+				it = changes.replayHashes.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	setBase(compaction.data, compaction.data->data(), compaction.data->size());
+	legacyFormat = false;
+
+	replaceFile(DB_FILENAME + ".tmp", DB_FILENAME);
+	rotateJournal(compaction.generation, compaction.journalOffset);
+}
+
+void PlayerDB::Compaction::run()
+{
+	try
+	{
+		data = std::make_shared<std::vector<char> >(snapshot.serialize(generation, journalOffset));
+		writeFile(snapshot.DB_FILENAME + ".tmp", *data);
+		success = true;
+	}
+	catch (std::exception & ex)
+	{
+		debug() << "Failed to compact player database: " << ex.what();
+	}
+
+	// Release the snapshot's reference to the database file, so that the file can be replaced.
+	snapshot.resetBase();
+}
 
-	if (stream.isValid() && header == HEADER)
+void PlayerDB::replayJournal()
+{
+	std::vector<char> journal;
+	if (!readFile(JOURNAL_FILENAME, journal) || journal.size() < JOURNAL_HEADER_SIZE
+		|| sf::Int32(readUint32(journal.data())) != JOURNAL_HEADER
+		|| sf::Int16(readUint16(journal.data() + 4)) != JOURNAL_VERSION)
 	{
-		std::map<sf::Uint64, EntryV0> entriesv0;
+		return;
+	}
 
-		switch (version)
+	sf::Uint32 generation = readUint32(journal.data() + 6);
+	std::size_t pos;
+	if (generation == baseGeneration)
+	{
+		pos = JOURNAL_HEADER_SIZE;
+	}
+	else if (generation + 1 == baseGeneration && basePreviousJournalSize >= JOURNAL_HEADER_SIZE)
+	{
+		// The database file was replaced, but the journal was not restarted afterwards.
+		pos = std::min<std::size_t>(basePreviousJournalSize, journal.size());
+	}
+	else
+	{
+		debug() << "Ignoring outdated player database journal " << JOURNAL_FILENAME;
+		return;
+	}
+
+	std::size_t start = pos;
+	while (pos < journal.size())
+	{
+		if (!applyJournalRecord(journal, pos))
 		{
-		case 0:
-			stream >> entriesv0;
-			break;
-		case 1:
-			stream >> entriesv0 >> replayHashes;
-			break;
-		case 2:
-			stream >> entries >> replayHashes;
+			// Most likely a record cut off by a crash; drop it so that new records can be appended after the last
+			// complete one.
+			debug() << "Discarding incomplete player database journal record at " << pos;
+			try
+			{
+				Poco::File(JOURNAL_FILENAME).setSize(pos);
+			}
+			catch (std::exception & ex)
+			{
+				debug() << "Failed to truncate player database journal: " << ex.what();
+			}
 			break;
-		default:
-			throw Error("Error loading player database: unrecognized version " + cNtoS(version));
+		}
+	}
+
+	journalSize = pos - start;
+}
+
+bool PlayerDB::applyJournalRecord(const std::vector<char> & journal, std::size_t & pos)
+{
+	const char * data = journal.data() + pos;
+	std::size_t remaining = journal.size() - pos;
+
+	switch (sf::Uint8(data[0]))
+	{
+	case JournalPlayer:
+	{
+		if (remaining < 20 || remaining < 20 + std::size_t(readUint16(data + 18)))
+		{
+			return false;
 		}
 
-		for (const auto & entry : entriesv0)
+		sf::Uint8 relation = data[9];
+		std::size_t nameLength = readUint16(data + 18);
+		applyPlayerToStats(readUint64(data + 1), std::string(data + 20, nameLength),
+			relation <= Enemy ? Relation(relation) : UnknownRelation, readUint64(data + 10));
+		pos += 20 + nameLength;
+		return true;
+	}
+	case JournalIPMapping:
+		if (remaining < 13)
+		{
+			return false;
+		}
+		getMutableEntry(readUint64(data + 1)).addIP(readUint32(data + 9));
+		pos += 13;
+		return true;
+	case JournalReplayHash:
+		if (remaining < 1 + V3_HASH_SIZE)
+		{
+			return false;
+		}
+		if (!hasBaseReplayHash(readHash(data + 1)))
 		{
-			entries.emplace(entry.first, entry.second);
+			getMutableOverlay().replayHashes.insert(readHash(data + 1));
 		}
+		pos += 1 + V3_HASH_SIZE;
+		return true;
+	default:
+		return false;
 	}
-	else
+}
+
+bool PlayerDB::readJournalState(sf::Uint32 & generation, sf::Uint64 & size) const
+{
+	generation = baseGeneration;
+	size = 0;
+
+	std::ifstream file(JOURNAL_FILENAME, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		return false;
+	}
+
+	sf::Uint64 fileSize = file.tellg();
+	char header[JOURNAL_HEADER_SIZE];
+	if (fileSize < JOURNAL_HEADER_SIZE || !file.seekg(0) || !file.read(header, JOURNAL_HEADER_SIZE)
+		|| sf::Int32(readUint32(header)) != JOURNAL_HEADER || sf::Int16(readUint16(header + 4)) != JOURNAL_VERSION)
+	{
+		return false;
+	}
+
+	// Only a journal applying to the base data may be continued.
+	sf::Uint32 fileGeneration = readUint32(header + 6);
+	if (fileGeneration != baseGeneration && fileGeneration + 1 != baseGeneration)
+	{
+		return false;
+	}
+
+	generation = fileGeneration;
+	size = fileSize;
+	return true;
+}
+
+void PlayerDB::rotateJournal(sf::Uint32 generation, sf::Uint64 offset)
+{
+	// Keep the records appended after the new database file was created from the journal.
+	std::vector<char> journal;
+	std::vector<char> rotated;
+	writeJournalHeader(rotated, generation);
+	if (readFile(JOURNAL_FILENAME, journal) && journal.size() >= JOURNAL_HEADER_SIZE && offset >= JOURNAL_HEADER_SIZE
+		&& offset < journal.size() && readUint32(journal.data() + 6) + 1 == generation)
+	{
+		rotated.insert(rotated.end(), journal.begin() + offset, journal.end());
+	}
+
+	journalSize = rotated.size() - JOURNAL_HEADER_SIZE;
+
+	try
+	{
+		writeFile(JOURNAL_FILENAME + ".tmp", rotated);
+		replaceFile(JOURNAL_FILENAME + ".tmp", JOURNAL_FILENAME);
+	}
+	catch (std::exception & ex)
+	{
+		// The old journal still applies to the new database file, starting at the recorded offset.
+		debug() << "Failed to restart player database journal: " << ex.what();
+	}
+}
+
+std::vector<char> PlayerDB::serialize(sf::Uint32 generation, sf::Uint64 previousJournalSize) const
+{
+	std::vector<char> entryTable;
+	std::vector<char> blob;
+	std::size_t entryCount = 0;
+
+	forEachEntry([&](sf::Uint64 steamID, const EntryV2 & entry)
+	{
+		writeUint64(entryTable, steamID);
+		writeUint64(entryTable, entry.sponsorSteamID);
+		writeUint32(entryTable, entry.allyCount);
+		writeUint32(entryTable, entry.enemyCount);
+		writeUint32(entryTable, blob.size());
+
+		std::size_t nameCount = std::min<std::size_t>(entry.names.size(), 0xFFFF);
+		writeUint16(blob, nameCount);
+		for (auto it = entry.names.begin(); nameCount > 0; ++it, --nameCount)
+		{
+			std::size_t length = std::min<std::size_t>(it->first.size(), 0xFFFF);
+			writeUint32(blob, it->second);
+			writeUint16(blob, length);
+			blob.insert(blob.end(), it->first.begin(), it->first.begin() + length);
+		}
+
+		std::size_t ipCount = std::min<std::size_t>(entry.ipAddresses.size(), 0xFF);
+		blob.push_back(ipCount);
+		for (std::size_t i = entry.ipAddresses.size() - ipCount; i < entry.ipAddresses.size(); ++i)
+		{
+			writeUint32(blob, entry.ipAddresses[i].toInteger());
+		}
+
+		++entryCount;
+	});
+
+	auto hashSet = getReplayHashes();
+	std::vector<ReplayParser::ReplayInfo::Hash> hashes(hashSet.begin(), hashSet.end());
+	std::sort(hashes.begin(), hashes.end(),
+		[](const ReplayParser::ReplayInfo::Hash & hash1, const ReplayParser::ReplayInfo::Hash & hash2)
+		{
+			return hash1.data < hash2.data;
+		});
+
+	std::vector<char> data;
+	data.reserve(V4_HEADER_SIZE + entryTable.size() + hashes.size() * V3_HASH_SIZE + blob.size());
+	writeUint32(data, HEADER);
+	writeUint16(data, VERSION);
+	writeUint32(data, entryCount);
+	writeUint32(data, hashes.size());
+	writeUint32(data, generation);
+	writeUint64(data, previousJournalSize);
+	data.insert(data.end(), entryTable.begin(), entryTable.end());
+	for (const auto & hash : hashes)
 	{
-		throw Error("Error loading player database: corrupt header");
+		writeHash(data, hash);
 	}
+	data.insert(data.end(), blob.begin(), blob.end());
+	return data;
 }
 
-void PlayerDB::save() const
+void PlayerDB::setBase(std::shared_ptr<const void> owner, const char * data, std::size_t size)
 {
-	sf::Int32 header = HEADER;
-	sf::Int16 version = 2;
+	resetBase();
+
+	if (size < V3_HEADER_SIZE)
+	{
+		throw Error("Error loading player database: truncated header");
+	}
+
+	std::size_t headerSize = V3_HEADER_SIZE;
+	if (sf::Int16(readUint16(data + 4)) >= 4)
+	{
+		if (size < V4_HEADER_SIZE)
+		{
+			throw Error("Error loading player database: truncated header");
+		}
+		headerSize = V4_HEADER_SIZE;
+		baseGeneration = readUint32(data + 14);
+		basePreviousJournalSize = readUint64(data + 18);
+	}
+
+	sf::Uint64 entryCount = readUint32(data + 6);
+	sf::Uint64 hashCount = readUint32(data + 10);
+	sf::Uint64 blobStart = headerSize + entryCount * V3_ENTRY_SIZE + hashCount * V3_HASH_SIZE;
 
-	DataStream stream;
-	if (!stream.openOutFile(DB_FILENAME))
+	if (blobStart > size)
 	{
-		throw Error("Error saving player database: could not write " + DB_FILENAME);
+		throw Error("Error loading player database: truncated entry table");
 	}
 
-	stream << header << version << entries << replayHashes;
+	baseOwner = std::move(owner);
+	baseEntries = data + headerSize;
+	baseHashes = baseEntries + entryCount * V3_ENTRY_SIZE;
+	baseBlob = data + blobStart;
+	baseEntryCount = entryCount;
+	baseHashCount = hashCount;
+	baseBlobSize = size - blobStart;
 }
 
-void PlayerDB::addPlayerToStats(const PlayerData& data, PlayerData::Team localTeam, sf::Uint64 sponsorSteamID)
+void PlayerDB::resetBase()
 {
-	//bool isNew = (entries.count(data.steamID) == 0);
+	baseOwner.reset();
+	baseEntries = nullptr;
+	baseHashes = nullptr;
+	baseBlob = nullptr;
+	baseEntryCount = 0;
+	baseHashCount = 0;
+	baseBlobSize = 0;
+	baseGeneration = 0;
+	basePreviousJournalSize = 0;
+	baseCleared = false;
+}
+
+bool PlayerDB::findBaseEntry(sf::Uint64 steamID, std::size_t & index) const
+{
+	std::size_t low = 0;
+	std::size_t high = baseEntryCount;
+	while (low < high)
+	{
+		std::size_t mid = low + (high - low) / 2;
+		if (getBaseSteamID(mid) < steamID)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
 
-	auto & entry = entries[data.steamID];
+	index = low;
+	return low < baseEntryCount && getBaseSteamID(low) == steamID;
+}
 
-	entry.addName(data.currentName);
+sf::Uint64 PlayerDB::getBaseSteamID(std::size_t index) const
+{
+	return readUint64(baseEntries + index * V3_ENTRY_SIZE);
+}
 
-	if (localTeam != PlayerData::UnknownTeam)
+PlayerDB::EntryV2 PlayerDB::readBaseEntry(std::size_t index) const
+{
+	const char * record = baseEntries + index * V3_ENTRY_SIZE;
+	EntryV2 entry;
+
+	if (!baseCleared)
+	{
+		entry.sponsorSteamID = readUint64(record + 8);
+		entry.allyCount = readUint32(record + 16);
+		entry.enemyCount = readUint32(record + 20);
+	}
+
+	std::size_t pos = readUint32(record + 24);
+	auto available = [&](std::size_t size)
+	{
+		return pos <= baseBlobSize && size <= baseBlobSize - pos;
+	};
+
+	if (!available(2))
+	{
+		debug() << "Player database entry " << getBaseSteamID(index) << " is corrupt";
+		return entry;
+	}
+
+	std::size_t nameCount = readUint16(baseBlob + pos);
+	pos += 2;
+	for (std::size_t i = 0; i < nameCount; ++i)
 	{
-		if (data.team == localTeam)
+		if (!available(6) || !available(6 + readUint16(baseBlob + pos + 4)))
 		{
-			entry.allyCount++;
+			debug() << "Player database entry " << getBaseSteamID(index) << " is corrupt";
+			entry.updateCommonName();
+			return entry;
+		}
+
+		sf::Uint32 count = readUint32(baseBlob + pos);
+		std::size_t length = readUint16(baseBlob + pos + 4);
+		if (!baseCleared)
+		{
+			entry.names.emplace(std::string(baseBlob + pos + 6, length), count);
+		}
+		pos += 6 + length;
+	}
+
+	// The names are not added with addName(), so the cached common name has to be set up here.
+	entry.updateCommonName();
+
+	if (!available(1) || !available(1 + 4 * sf::Uint8(baseBlob[pos])))
+	{
+		debug() << "Player database entry " << getBaseSteamID(index) << " is corrupt";
+		return entry;
+	}
+
+	std::size_t ipCount = sf::Uint8(baseBlob[pos]);
+	pos += 1;
+	for (std::size_t i = 0; i < ipCount; ++i)
+	{
+		entry.ipAddresses.push_back(sf::IpAddress(readUint32(baseBlob + pos)));
+		pos += 4;
+	}
+
+	return entry;
+}
+
+bool PlayerDB::hasBaseReplayHash(const ReplayParser::ReplayInfo::Hash & hash) const
+{
+	if (baseCleared)
+	{
+		return false;
+	}
+
+	std::size_t low = 0;
+	std::size_t high = baseHashCount;
+	while (low < high)
+	{
+		std::size_t mid = low + (high - low) / 2;
+		auto midHash = readHash(baseHashes + mid * V3_HASH_SIZE);
+		if (midHash.data < hash.data)
+		{
+			low = mid + 1;
+		}
+		else if (hash.data < midHash.data)
+		{
+			high = mid;
 		}
 		else
 		{
-			entry.enemyCount++;
+			return true;
 		}
 	}
+	return false;
+}
+
+bool PlayerDB::findEntry(sf::Uint64 steamID, EntryV2 & entry) const
+{
+	const PlayerTable::Record * record = overlay->entries.find(steamID);
+	if (record != nullptr)
+	{
+		entry = makeEntry(*record);
+		return true;
+	}
+
+	std::size_t index;
+	if (findBaseEntry(steamID, index))
+	{
+		entry = readBaseEntry(index);
+		return true;
+	}
+
+	return false;
+}
+
+PlayerDB::Overlay & PlayerDB::getMutableOverlay()
+{
+	// Copies of the database share their overlay until one of them changes it. Once the use count has dropped to one,
+	// all other copies are done with the overlay; the fence orders their last accesses before the following changes.
+	if (overlay.use_count() > 1)
+	{
+		overlay = std::make_shared<Overlay>(*overlay);
+	}
+	else
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+	return *overlay;
+}
+
+PlayerTable::Record & PlayerDB::getMutableEntry(sf::Uint64 steamID)
+{
+	Overlay & changes = getMutableOverlay();
+	PlayerTable::Record * record = changes.entries.find(steamID);
+	if (record != nullptr)
+	{
+		return *record;
+	}
+
+	std::size_t index;
+	if (findBaseEntry(steamID, index))
+	{
+		EntryV2 baseEntry = readBaseEntry(index);
+		PlayerTable::Record & newRecord = changes.entries.get(steamID);
+		assignRecord(newRecord, baseEntry);
+		return newRecord;
+	}
+
+	return changes.entries.get(steamID);
+}
+
+PlayerDB::EntryV2 PlayerDB::makeEntry(const PlayerTable::Record & record) const
+{
+	EntryV2 entry;
+	for (std::size_t i = 0; i < record.getNameCount(); ++i)
+	{
+		entry.addName(overlay->entries.getName(record.getName(i).name), record.getName(i).count);
+	}
+	entry.sponsorSteamID = record.sponsorSteamID;
+	entry.allyCount = record.allyCount;
+	entry.enemyCount = record.enemyCount;
+	for (std::size_t i = 0; i < record.ipCount; ++i)
+	{
+		entry.ipAddresses.push_back(sf::IpAddress(record.ipAddresses[i]));
+	}
+	return entry;
+}
+
+void PlayerDB::assignRecord(PlayerTable::Record & record, const EntryV2 & entry)
+{
+	record.clearStats();
+	for (const auto & name : entry.names)
+	{
+		getMutableOverlay().entries.addName(record, name.first, name.second);
+	}
+	record.sponsorSteamID = entry.sponsorSteamID;
+	record.allyCount = entry.allyCount;
+	record.enemyCount = entry.enemyCount;
+	record.ipCount = 0;
+	for (auto ip : entry.ipAddresses)
+	{
+		record.addIP(ip.toInteger());
+	}
+}
+
+void PlayerDB::addPlayerToStats(const PlayerData& data, PlayerData::Team localTeam, sf::Uint64 sponsorSteamID)
+{
+	Relation relation = UnknownRelation;
+	if (localTeam != PlayerData::UnknownTeam)
+	{
+		relation = (data.team == localTeam) ? Ally : Enemy;
+	}
+
+	applyPlayerToStats(data.steamID, data.currentName, relation, sponsorSteamID);
+
+	if (journaling)
+	{
+		std::size_t nameLength = std::min<std::size_t>(data.currentName.size(), 0xFFFF);
+		journalBuffer.push_back(JournalPlayer);
+		writeUint64(journalBuffer, data.steamID);
+		journalBuffer.push_back(relation);
+		writeUint64(journalBuffer, sponsorSteamID);
+		writeUint16(journalBuffer, nameLength);
+		journalBuffer.insert(journalBuffer.end(), data.currentName.begin(), data.currentName.begin() + nameLength);
+	}
+}
+
+void PlayerDB::applyPlayerToStats(sf::Uint64 steamID, const std::string & name, Relation relation,
+	sf::Uint64 sponsorSteamID)
+{
+	//bool isNew = (entries.count(data.steamID) == 0);
+
+	auto & entry = getMutableEntry(steamID);
+
+	getMutableOverlay().entries.addName(entry, name);
+
+	if (relation == Ally)
+	{
+		entry.allyCount++;
+	}
+	else if (relation == Enemy)
+	{
+		entry.enemyCount++;
+	}
 
 	if (sponsorSteamID != 0)
 	{
@@ -145,15 +1002,12 @@ void PlayerDB::fillPlayerData(PlayerData& data, std::size_t recursion) const
 
 void PlayerDB::fillPlayerData(PlayerData & data, PlayerData & sponsor, std::size_t recursion) const
 {
-	auto it = entries.find(data.steamID);
-
-	if (it == entries.end() || recursion > 50)
+	EntryV2 entry;
+	if (!findEntry(data.steamID, entry) || recursion > 50)
 	{
 		return;
 	}
 
-	const auto & entry = it->second;
-
 	auto commonName = entry.getCommonName();
 	if (data.currentName != commonName)
 	{
@@ -181,57 +1035,213 @@ void PlayerDB::fillPlayerData(PlayerData & data, PlayerData & sponsor, std::size
 
 PlayerDB::EntryV2 PlayerDB::getEntry(sf::Uint64 steamID) const
 {
-	auto it = entries.find(steamID);
+	EntryV2 entry;
+	findEntry(steamID, entry);
+	return entry;
+}
+
+bool PlayerDB::hasReplayHash(ReplayParser::ReplayInfo::Hash hash) const
+{
+	return overlay->replayHashes.count(hash) || hasBaseReplayHash(hash);
+}
 
-	if (it == entries.end())
+void PlayerDB::addReplayHash(ReplayParser::ReplayInfo::Hash hash)
+{
+	if (!hasBaseReplayHash(hash))
 	{
-		static PlayerDB::EntryV2 ded;
-		return ded;
+		getMutableOverlay().replayHashes.insert(hash);
 	}
-	else
+
+	if (journaling)
 	{
-		return it->second;
+		journalBuffer.push_back(JournalReplayHash);
+		writeHash(journalBuffer, hash);
 	}
 }
 
-bool PlayerDB::hasReplayHash(ReplayParser::ReplayInfo::Hash hash) const
+std::unordered_set<ReplayParser::ReplayInfo::Hash> PlayerDB::getReplayHashes() const
 {
-	return replayHashes.count(hash);
+	std::unordered_set<ReplayParser::ReplayInfo::Hash> hashes = overlay->replayHashes;
+	if (!baseCleared)
+	{
+		for (std::size_t i = 0; i < baseHashCount; ++i)
+		{
+			hashes.insert(readHash(baseHashes + i * V3_HASH_SIZE));
+		}
+	}
+	return hashes;
 }
 
-void PlayerDB::addReplayHash(ReplayParser::ReplayInfo::Hash hash)
+void PlayerDB::merge(const PlayerDB & other)
 {
-	replayHashes.insert(hash);
+	other.forEachEntry([&](sf::Uint64 steamID, const EntryV2 & otherEntry)
+	{
+		auto & entry = getMutableEntry(steamID);
+
+		for (const auto & name : otherEntry.names)
+		{
+			getMutableOverlay().entries.addName(entry, name.first, name.second);
+		}
+
+		entry.allyCount += otherEntry.allyCount;
+		entry.enemyCount += otherEntry.enemyCount;
+
+		if (otherEntry.sponsorSteamID != 0)
+		{
+			entry.sponsorSteamID = otherEntry.sponsorSteamID;
+		}
+
+		for (auto ip : otherEntry.ipAddresses)
+		{
+			entry.addIP(ip.toInteger());
+			addToIPIndex(ip.toInteger(), steamID);
+		}
+	});
+
+	for (const auto & hash : other.getReplayHashes())
+	{
+		addReplayHash(hash);
+	}
 }
 
 std::size_t PlayerDB::getReplayHashCount() const
 {
-	return replayHashes.size();
+	return overlay->replayHashes.size() + (baseCleared ? 0 : baseHashCount);
 }
 
 std::size_t PlayerDB::getPlayerCount() const
 {
-	return entries.size();
+	std::size_t count = baseEntryCount;
+	overlay->entries.forEach([&](const PlayerTable::Record & record)
+	{
+		std::size_t index;
+		if (!findBaseEntry(record.steamID, index))
+		{
+			++count;
+		}
+	});
+	return count;
 }
 
 void PlayerDB::clear()
 {
-	for (auto & entry : entries)
+	Overlay & changes = getMutableOverlay();
+	changes.entries.clearStats();
+	changes.replayHashes.clear();
+	baseCleared = true;
+}
+
+void PlayerDB::addIPMapping(sf::Uint64 steamID, sf::IpAddress ip)
+{
+	auto & entry = getMutableEntry(steamID);
+
+	// The same mappings are found in every startup scan of the network logs, so only journal actual changes.
+	if (journaling && entry.getRecentIP() != ip.toInteger())
 	{
-		entry.second.clear();
+		journalBuffer.push_back(JournalIPMapping);
+		writeUint64(journalBuffer, steamID);
+		writeUint32(journalBuffer, ip.toInteger());
 	}
 
-	replayHashes.clear();
+	entry.addIP(ip.toInteger());
+	addToIPIndex(ip.toInteger(), steamID);
 }
 
-void PlayerDB::addIPMapping(sf::Uint64 steamID, sf::IpAddress ip)
+std::vector<sf::Uint64> PlayerDB::getPlayersByIP(sf::IpAddress ip) const
 {
-	entries[steamID].addIP(ip);
+	std::vector<sf::Uint64> steamIDs;
+	const IPIndex & index = getIPIndex();
+	auto it = index.find(ip.toInteger());
+	if (it != index.end())
+	{
+		steamIDs = it->second;
+		filterPlayersByIP(ip.toInteger(), steamIDs);
+	}
+	return steamIDs;
+}
+
+void PlayerDB::forEachSharedIP(
+	std::function<void(sf::IpAddress ip, const std::vector<sf::Uint64> & steamIDs)> callback) const
+{
+	const IPIndex & index = getIPIndex();
+
+	std::vector<sf::Uint32> ips;
+	for (const auto & players : index)
+	{
+		if (players.second.size() > 1)
+		{
+			ips.push_back(players.first);
+		}
+	}
+	std::sort(ips.begin(), ips.end());
+
+	for (auto ip : ips)
+	{
+		std::vector<sf::Uint64> steamIDs = index.find(ip)->second;
+		filterPlayersByIP(ip, steamIDs);
+		if (steamIDs.size() > 1)
+		{
+			callback(sf::IpAddress(ip), steamIDs);
+		}
+	}
+}
+
+const PlayerDB::IPIndex & PlayerDB::getIPIndex() const
+{
+	if (!ipIndex)
+	{
+		auto index = std::make_shared<IPIndex>();
+		forEachEntry([&](sf::Uint64 steamID, const EntryV2 & entry)
+		{
+			for (auto ip : entry.ipAddresses)
+			{
+				(*index)[ip.toInteger()].push_back(steamID);
+			}
+		});
+		ipIndex = index;
+	}
+	return *ipIndex;
+}
+
+void PlayerDB::addToIPIndex(sf::Uint32 ip, sf::Uint64 steamID)
+{
+	// Without an index, there is nothing to keep up to date; it includes all changes once it is built.
+	if (!ipIndex)
+	{
+		return;
+	}
+
+	if (ipIndex.use_count() > 1)
+	{
+		ipIndex = std::make_shared<IPIndex>(*ipIndex);
+	}
+	else
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	auto & steamIDs = (*ipIndex)[ip];
+	if (std::find(steamIDs.begin(), steamIDs.end(), steamID) == steamIDs.end())
+	{
+		steamIDs.push_back(steamID);
+	}
+}
+
+void PlayerDB::filterPlayersByIP(sf::Uint32 ip, std::vector<sf::Uint64> & steamIDs) const
+{
+	// Entries only keep their most recent addresses, so players may no longer list an address they were indexed with.
+	steamIDs.erase(std::remove_if(steamIDs.begin(), steamIDs.end(), [&](sf::Uint64 steamID)
+	{
+		EntryV2 entry;
+		return !findEntry(steamID, entry) || std::find(entry.ipAddresses.begin(), entry.ipAddresses.end(),
+			sf::IpAddress(ip)) == entry.ipAddresses.end();
+	}), steamIDs.end());
+	std::sort(steamIDs.begin(), steamIDs.end());
 }
 
 bool PlayerDB::empty() const
 {
-	return entries.empty();
+	return overlay->entries.empty() && baseEntryCount == 0;
 }
 
 DataStream& operator <<(DataStream& stream, const sf::IpAddress & ip)
@@ -254,7 +1264,9 @@ DataStream& operator <<(DataStream& stream, const PlayerDB::EntryV0& entry)
 
 DataStream& operator >>(DataStream& stream, PlayerDB::EntryV0& entry)
 {
-	return stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID;
+	stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID;
+	entry.updateCommonName();
+	return stream;
 }
 
 DataStream& operator <<(DataStream& stream, const PlayerDB::EntryV1& entry)
@@ -265,8 +1277,10 @@ DataStream& operator <<(DataStream& stream, const PlayerDB::EntryV1& entry)
 
 DataStream& operator >>(DataStream& stream, PlayerDB::EntryV1& entry)
 {
-	return stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID >> entry.lastKnownLeague
+	stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID >> entry.lastKnownLeague
 		>> entry.lastKnownRank >> entry.lastKnownRating;
+	entry.updateCommonName();
+	return stream;
 }
 
 DataStream& operator <<(DataStream& stream, const PlayerDB::EntryV2& entry)
@@ -276,7 +1290,9 @@ DataStream& operator <<(DataStream& stream, const PlayerDB::EntryV2& entry)
 
 DataStream& operator >>(DataStream& stream, PlayerDB::EntryV2& entry)
 {
-	return stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID >> entry.ipAddresses;
+	stream >> entry.names >> entry.allyCount >> entry.enemyCount >> entry.sponsorSteamID >> entry.ipAddresses;
+	entry.updateCommonName();
+	return stream;
 }
 
 sf::IpAddress PlayerDB::EntryV2::getRecentIP() const
@@ -286,8 +1302,6 @@ sf::IpAddress PlayerDB::EntryV2::getRecentIP() const
 
 void PlayerDB::EntryV2::addIP(sf::IpAddress ip)
 {
-	static const std::size_t MAX_IP_COUNT = 10;
-
 	for (auto it = ipAddresses.begin(); it != ipAddresses.end(); ++it)
 	{
 		if (ip == *it)
@@ -298,7 +1312,7 @@ void PlayerDB::EntryV2::addIP(sf::IpAddress ip)
 	}
 	ipAddresses.push_back(ip);
 
-	while (ipAddresses.size() > MAX_IP_COUNT)
+	while (ipAddresses.size() > PlayerTable::MAX_IP_COUNT)
 	{
 		ipAddresses.erase(ipAddresses.begin());
 	}
@@ -307,13 +1321,36 @@ void PlayerDB::EntryV2::addIP(sf::IpAddress ip)
 void PlayerDB::EntryV2::clear()
 {
 	names.clear();
+	updateCommonName();
 	sponsorSteamID = 0;
 	allyCount = 0;
 	enemyCount = 0;
 	// Preserve IPs
 }
 
-const std::map<sf::Uint64, PlayerDB::EntryV2>& PlayerDB::getEntries() const
+void PlayerDB::forEachEntry(std::function<void(sf::Uint64 steamID, const EntryV2 & entry)> callback) const
 {
-	return entries;
+	std::size_t index = 0;
+
+	// Both the base entries and the overlay are visited in SteamID order; overlay entries replace base entries.
+	overlay->entries.forEachSorted([&](const PlayerTable::Record & record)
+	{
+		while (index < baseEntryCount && getBaseSteamID(index) < record.steamID)
+		{
+			callback(getBaseSteamID(index), readBaseEntry(index));
+			++index;
+		}
+
+		if (index < baseEntryCount && getBaseSteamID(index) == record.steamID)
+		{
+			++index;
+		}
+
+		callback(record.steamID, makeEntry(record));
+	});
+
+	for (; index < baseEntryCount; ++index)
+	{
+		callback(getBaseSteamID(index), readBaseEntry(index));
+	}
 }
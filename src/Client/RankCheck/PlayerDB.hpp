@@ -2,16 +2,33 @@
 #define SRC_CLIENT_RANKCHECK_PLAYERDB_HPP_
 
 #include <Client/RankCheck/PlayerData.hpp>
+#include <Client/RankCheck/PlayerTable.hpp>
 #include <Client/RankCheck/ReplayParser.hpp>
 #include <SFML/Config.hpp>
 #include <cstddef>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 class DataStream;
 
+/**
+ * Per-player statistics collected from replays and network logs, stored in RankCheck's data directory.
+ *
+ * The current file format (version 4) consists of a SteamID-sorted table of fixed-size entries, a sorted list of replay
+ * hashes and a region holding each entry's names and IP addresses. The file is memory-mapped on load and queried in
+ * place, so loading takes the same time regardless of the database size. Changes are kept in an in-memory overlay, a
+ * PlayerTable, until the database is saved. Files in older formats are read completely and converted on the next save.
+ *
+ * Between saves, changes are recorded in an append-only journal next to the database file, which is replayed on load.
+ * Each database file has a generation number; the journal applies to the database file of the same generation, or,
+ * starting at the recorded offset, to the one after it. This keeps the journal valid if the program exits between
+ * replacing the database file and starting a new journal. Compaction folds the journal into a new database file.
+ */
 class PlayerDB
 {
 public:
@@ -25,7 +42,18 @@ public:
 		sf::Uint32 enemyCount = 0;
 
 		std::string getCommonName() const;
-		void addName(const std::string & name);
+		void addName(const std::string & name, sf::Uint32 count = 1);
+
+		/**
+		 * Recomputes the cached common name after names has been modified directly.
+		 */
+		void updateCommonName();
+
+	private:
+
+		// Most frequently used name, maintained by addName().
+		std::string commonName;
+		sf::Uint32 commonNameCount = 0;
 	};
 
 	struct EntryV1 : public EntryV0
@@ -60,13 +88,58 @@ public:
 		void clear();
 	};
 
+	class Compaction;
+
 	PlayerDB();
 	~PlayerDB();
 
+	PlayerDB(const PlayerDB & other) = default;
+	PlayerDB & operator=(const PlayerDB & other) = default;
+
+	/**
+	 * Moving leaves the source database empty, without a reference to the mapped file.
+	 */
+	PlayerDB(PlayerDB && other);
+	PlayerDB & operator=(PlayerDB && other);
+
 	void clear();
 
 	void load();
-	void save() const;
+
+	/**
+	 * Writes the database in the current format and starts a new journal. Afterwards, the database is backed by the
+	 * written data.
+	 */
+	void save();
+
+	/**
+	 * Enables or disables recording changes in the journal. Journaling is enabled by load().
+	 *
+	 * Disabling journaling discards changes that have not been written to the journal yet.
+	 */
+	void setJournaling(bool enabled);
+
+	/**
+	 * Appends the changes recorded since the last call to the journal file.
+	 */
+	void flushJournal();
+
+	/**
+	 * Returns true if the journal holds at least maxJournalSize bytes, or if the database was loaded from a file in an
+	 * older format.
+	 */
+	bool needsCompaction(std::size_t maxJournalSize) const;
+
+	/**
+	 * Flushes the journal and takes a snapshot of the database, which can then be written on another thread.
+	 */
+	std::unique_ptr<Compaction> startCompaction();
+
+	/**
+	 * Replaces the database file with the one written by a finished compaction, and removes the journal records it
+	 * includes. Changes made since the compaction was started are kept.
+	 */
+	void finishCompaction(Compaction & compaction);
 
 	void addPlayerToStats(const PlayerData & data, PlayerData::Team localTeam, sf::Uint64 sponsorSteamID);
 	void fillPlayerData(PlayerData & data, std::size_t recursion = 0) const;
@@ -76,19 +149,148 @@ public:
 
 	bool hasReplayHash(ReplayParser::ReplayInfo::Hash hash) const;
 	void addReplayHash(ReplayParser::ReplayInfo::Hash hash);
+	std::unordered_set<ReplayParser::ReplayInfo::Hash> getReplayHashes() const;
+
+	/**
+	 * Adds the contents of another database to this one, as if the replays added to it had been added here.
+	 *
+	 * Name and ally/enemy counts are summed up, and the other database's sponsor and IP addresses take precedence.
+	 * Replays known to both databases are not detected; callers need to check for them beforehand.
+	 */
+	void merge(const PlayerDB & other);
+
+	/**
+	 * Returns the SteamIDs of all players whose entry lists the specified IP address, in ascending order.
+	 *
+	 * The first query scans the whole database to build an index of IP addresses, which is kept up to date by later
+	 * changes. Subsequent queries only look at the players seen with the address.
+	 */
+	std::vector<sf::Uint64> getPlayersByIP(sf::IpAddress ip) const;
+
+	/**
+	 * Calls the specified function for every IP address listed by more than one player, in ascending address order,
+	 * with the players' SteamIDs in ascending order. Uses the same index as getPlayersByIP().
+	 */
+	void forEachSharedIP(std::function<void(sf::IpAddress ip, const std::vector<sf::Uint64> & steamIDs)> callback) const;
 
 	std::size_t getReplayHashCount() const;
+
+	/**
+	 * Looks up every entry of the overlay in the base data, so this is too slow to call every frame.
+	 */
 	std::size_t getPlayerCount() const;
 
 	bool empty() const;
 
-	const std::map<sf::Uint64, EntryV2> & getEntries() const;
+	/**
+	 * Calls the specified function for every entry, in ascending SteamID order.
+	 */
+	void forEachEntry(std::function<void(sf::Uint64 steamID, const EntryV2 & entry)> callback) const;
 
 private:
 
+	struct Overlay
+	{
+		PlayerTable entries;
+		std::unordered_set<ReplayParser::ReplayInfo::Hash> replayHashes;
+	};
+
+	// SteamIDs seen with each IP address. Players may have dropped an address since, so lookups check the entries.
+	typedef std::unordered_map<sf::Uint32, std::vector<sf::Uint64> > IPIndex;
+
+	enum Relation
+	{
+		UnknownRelation,
+		Ally,
+		Enemy
+	};
+
+	void applyPlayerToStats(sf::Uint64 steamID, const std::string & name, Relation relation, sf::Uint64 sponsorSteamID);
+
+	void replayJournal();
+	bool applyJournalRecord(const std::vector<char> & journal, std::size_t & pos);
+	bool readJournalState(sf::Uint32 & generation, sf::Uint64 & size) const;
+	void rotateJournal(sf::Uint32 generation, sf::Uint64 offset);
+
+	void setBase(std::shared_ptr<const void> owner, const char * data, std::size_t size);
+	void resetBase();
+
+	bool findBaseEntry(sf::Uint64 steamID, std::size_t & index) const;
+	sf::Uint64 getBaseSteamID(std::size_t index) const;
+	EntryV2 readBaseEntry(std::size_t index) const;
+	bool hasBaseReplayHash(const ReplayParser::ReplayInfo::Hash & hash) const;
+
+	Overlay & getMutableOverlay();
+
+	bool findEntry(sf::Uint64 steamID, EntryV2 & entry) const;
+	PlayerTable::Record & getMutableEntry(sf::Uint64 steamID);
+	EntryV2 makeEntry(const PlayerTable::Record & record) const;
+
+	const IPIndex & getIPIndex() const;
+	void addToIPIndex(sf::Uint32 ip, sf::Uint64 steamID);
+	void filterPlayersByIP(sf::Uint32 ip, std::vector<sf::Uint64> & steamIDs) const;
+	void assignRecord(PlayerTable::Record & record, const EntryV2 & entry);
+
+	std::vector<char> serialize(sf::Uint32 generation, sf::Uint64 previousJournalSize) const;
+
 	std::string DB_FILENAME;
-	std::map<sf::Uint64, EntryV2> entries;
-	std::unordered_set<ReplayParser::ReplayInfo::Hash> replayHashes;
+	std::string JOURNAL_FILENAME;
+
+	// Data of the last loaded or saved version 3 or 4 file, kept alive by baseOwner.
+	std::shared_ptr<const void> baseOwner;
+	const char * baseEntries = nullptr;
+	const char * baseHashes = nullptr;
+	const char * baseBlob = nullptr;
+	std::size_t baseEntryCount = 0;
+	std::size_t baseHashCount = 0;
+	std::size_t baseBlobSize = 0;
+	sf::Uint32 baseGeneration = 0;
+	sf::Uint64 basePreviousJournalSize = 0;
+
+	// If set, the base data is treated as if clear() had been called on it.
+	bool baseCleared = false;
+
+	// Entries and replay hashes added or changed since the base data was loaded. Copies of the database share the
+	// overlay until one of them changes it, so taking a snapshot for another thread does not copy any entries.
+	std::shared_ptr<Overlay> overlay;
+
+	// Built by the first IP address query. Shared between copies of the database like the overlay.
+	mutable std::shared_ptr<IPIndex> ipIndex;
+
+	// Set if the database was loaded from a file in a format older than version 3.
+	bool legacyFormat = false;
+
+	// Journal records not yet written to the journal file, and the size of the records in the file that apply to the
+	// base data.
+	bool journaling = false;
+	std::vector<char> journalBuffer;
+	std::size_t journalSize = 0;
+};
+
+/**
+ * Snapshot of a player database, to be written to a new database file on a background thread.
+ *
+ * Created by PlayerDB::startCompaction(). After run() has returned, the compaction is passed back to
+ * PlayerDB::finishCompaction() on the thread owning the database.
+ */
+class PlayerDB::Compaction
+{
+public:
+
+	/**
+	 * Writes the snapshot to a temporary file. Errors are logged and cause finishCompaction() to do nothing.
+	 */
+	void run();
+
+private:
+
+	friend class PlayerDB;
+
+	PlayerDB snapshot;
+	sf::Uint32 generation = 0;
+	sf::Uint64 journalOffset = 0;
+	std::shared_ptr<std::vector<char> > data;
+	bool success = false;
 };
 
 DataStream & operator<<(DataStream & stream, const PlayerDB::EntryV0 & entry);
@@ -1,225 +1,359 @@
 #include <Client/RankCheck/CountryLookup.hpp>
 #include <Client/RankCheck/NautsNames.hpp>
 #include <Client/RankCheck/PlayerData.hpp>
-#include <Shared/Utils/StrNumCon.hpp>
 #include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <cstddef>
-#include <functional>
+#include <cstdio>
 #include <iterator>
-#include <map>
 #include <utility>
 
-static std::map<std::string, std::function<std::string(const PlayerData &)>> expressions =
+namespace
+{
+
+// Appends the value of an expression for a player to the output.
+using Expression = void (*)(const PlayerData & data, std::string & output);
+
+// Returns true if the value of an expression for a player is not empty, without building the value.
+using Test = bool (*)(const PlayerData & data);
+
+struct NamedExpression
+{
+	const char * name;
+	Expression expression;
+	Test test;
+};
+
+}
+
+static void appendNumber(std::string & output, int number)
+{
+	char buffer[16];
+	output.append(buffer, std::snprintf(buffer, sizeof(buffer), "%d", number));
+}
+
+// Same format as cNtoS() for floats.
+static void appendNumber(std::string & output, float number)
+{
+	char buffer[32];
+	output.append(buffer, std::snprintf(buffer, sizeof(buffer), "%g", number));
+}
+
+// Test for expressions whose value is never empty, such as numbers.
+static bool isNeverEmpty(const PlayerData & data)
+{
+	return true;
+}
+
+static const NamedExpression expressions[] =
 {
 	{
-		"always", [](const PlayerData & data)
+		"always", [](const PlayerData & data, std::string & output)
 		{
-			return "1";
-		}
+			output += '1';
+		},
+		isNeverEmpty
 	},
 	{
-		"islocal", [](const PlayerData & data)
+		"islocal", [](const PlayerData & data, std::string & output)
+		{
+			output += data.isLocal ? "1" : "";
+		},
+		[](const PlayerData & data)
 		{
-			return data.isLocal ? "1" : "";
+			return data.isLocal;
 		}
 	},
 	{
-		"hasleaderboarddata", [](const PlayerData & data)
+		"hasleaderboarddata", [](const PlayerData & data, std::string & output)
 		{
-			return data.hasLeaderboardData ? "1" : "";
+			output += data.hasLeaderboardData ? "1" : "";
+		},
+		[](const PlayerData & data)
+		{
+			return data.hasLeaderboardData;
 		}
 	},
 	{
-		"steamid", [](const PlayerData & data)
+		"steamid", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.steamID);
-		}
+			char buffer[24];
+			output.append(buffer, std::snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long) data.steamID));
+		},
+		isNeverEmpty
 	},
 	{
-		"ip", [](const PlayerData & data)
+		"ip", [](const PlayerData & data, std::string & output)
 		{
-			return data.ip == sf::IpAddress::None ? "" : data.ip.toString();
+			if (data.ip != sf::IpAddress::None)
+			{
+				output += data.ip.toString();
+			}
+		},
+		[](const PlayerData & data)
+		{
+			return data.ip != sf::IpAddress::None;
 		}
 	},
 	{
-		"country", [](const PlayerData & data)
+		"country", [](const PlayerData & data, std::string & output)
+		{
+			output += data.country;
+		},
+		[](const PlayerData & data)
 		{
-			return data.country;
+			return !data.country.empty();
 		}
 	},
 	{
-		"countrycode", [](const PlayerData & data)
+		"countrycode", [](const PlayerData & data, std::string & output)
 		{
-			return data.countryCode;
+			output += data.countryCode;
+		},
+		[](const PlayerData & data)
+		{
+			return !data.countryCode.empty();
 		}
 	},
 	{
-		"hascountry", [](const PlayerData & data)
+		"hascountry", [](const PlayerData & data, std::string & output)
+		{
+			output += (data.countryCode != CountryLookup::invalidCountry && !data.countryCode.empty()) ? "1" : "";
+		},
+		[](const PlayerData & data)
 		{
-			return (data.countryCode != CountryLookup::invalidCountry && !data.countryCode.empty()) ? "1" : "";
+			return data.countryCode != CountryLookup::invalidCountry && !data.countryCode.empty();
 		}
 	},
 	{
-		"accounttype", [](const PlayerData & data)
+		"accounttype", [](const PlayerData & data, std::string & output)
 		{
 			switch (data.type)
 			{
 			case PlayerData::Player:
 			default:
-				return "";
+				break;
 			case PlayerData::SponsoredPlayer:
-				return "Alt";
+				output += "Alt";
+				break;
 			case PlayerData::Sponsor:
-				return "Main";
+				output += "Main";
+				break;
 			}
+		},
+		[](const PlayerData & data)
+		{
+			return data.type == PlayerData::SponsoredPlayer || data.type == PlayerData::Sponsor;
 		}
 	},
 	{
-		"name", [](const PlayerData & data)
+		"name", [](const PlayerData & data, std::string & output)
+		{
+			output += data.currentName.empty() ? data.commonName : data.currentName;
+		},
+		[](const PlayerData & data)
 		{
-			return data.currentName.empty() ? data.commonName : data.currentName;
+			return !data.currentName.empty() || !data.commonName.empty();
 		}
 	},
 	{
-		"commonname", [](const PlayerData & data) -> std::string
+		"commonname", [](const PlayerData & data, std::string & output)
 		{
-			if (data.currentName.empty())
+			if (!data.currentName.empty() && data.currentName != data.commonName)
 			{
-				return "";
-			}
-			else
-			{
-				return data.currentName == data.commonName ? "" : data.commonName;
+				output += data.commonName;
 			}
+		},
+		[](const PlayerData & data)
+		{
+			return !data.currentName.empty() && data.currentName != data.commonName && !data.commonName.empty();
 		}
 	},
 	{
-		"team", [](const PlayerData & data)
+		"team", [](const PlayerData & data, std::string & output)
 		{
 			switch (data.team)
 			{
 			default:
-				return "";
+				break;
 			case PlayerData::Red:
-				return "Red";
+				output += "Red";
+				break;
 			case PlayerData::Blue:
-				return "Blue";
+				output += "Blue";
+				break;
 			}
+		},
+		[](const PlayerData & data)
+		{
+			return data.team == PlayerData::Red || data.team == PlayerData::Blue;
 		}
 	},
 	{
-		"currentnaut", [](const PlayerData & data)
+		"currentnaut", [](const PlayerData & data, std::string & output)
 		{
-			return NautsNames::getInstance().getNautName(data.currentNaut);
+			output += NautsNames::getInstance().getNautName(data.currentNaut);
+		},
+		[](const PlayerData & data)
+		{
+			return !NautsNames::getInstance().getNautName(data.currentNaut).empty();
 		}
 	},
 	{
-		"currentskin", [](const PlayerData & data)
+		"currentskin", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.currentSkin);
-		}
+			appendNumber(output, data.currentSkin);
+		},
+		isNeverEmpty
 	},
 	{
-		"mainnaut", [](const PlayerData & data)
+		"mainnaut", [](const PlayerData & data, std::string & output)
 		{
-			return NautsNames::getInstance().getNautName(data.mainNaut);
+			output += NautsNames::getInstance().getNautName(data.mainNaut);
+		},
+		[](const PlayerData & data)
+		{
+			return !NautsNames::getInstance().getNautName(data.mainNaut).empty();
 		}
 	},
 	{
-		"rank", [](const PlayerData & data)
+		"rank", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.rank);
-		}
+			appendNumber(output, data.rank);
+		},
+		isNeverEmpty
 	},
 	{
-		"#rank", [](const PlayerData & data)
+		"#rank", [](const PlayerData & data, std::string & output)
 		{
-			return data.rank == 0 ? "Unranked" : "#" + cNtoS(data.rank);
-		}
+			if (data.rank == 0)
+			{
+				output += "Unranked";
+			}
+			else
+			{
+				output += '#';
+				appendNumber(output, data.rank);
+			}
+		},
+		isNeverEmpty
 	},
 	{
-		"rating", [](const PlayerData & data)
+		"rating", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.rating);
-		}
+			appendNumber(output, data.rating);
+		},
+		isNeverEmpty
 	},
 	{
-		"prevrank", [](const PlayerData & data)
+		"prevrank", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.prevRank);
-		}
+			appendNumber(output, data.prevRank);
+		},
+		isNeverEmpty
 	},
 	{
-		"prevrating", [](const PlayerData & data)
+		"prevrating", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.prevRating);
-		}
+			appendNumber(output, data.prevRating);
+		},
+		isNeverEmpty
 	},
 	{
-		"wincount", [](const PlayerData & data)
+		"wincount", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.winCount);
-		}
+			appendNumber(output, data.winCount);
+		},
+		isNeverEmpty
 	},
 	{
-		"losscount", [](const PlayerData & data)
+		"losscount", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.lossCount);
-		}
+			appendNumber(output, data.lossCount);
+		},
+		isNeverEmpty
 	},
 	{
-		"matchcount", [](const PlayerData & data) -> std::string
+		"matchcount", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.winCount + data.lossCount);
-		}
+			appendNumber(output, data.winCount + data.lossCount);
+		},
+		isNeverEmpty
 	},
 	{
-		"matchcounttotal", [](const PlayerData & data) -> std::string
+		"matchcounttotal", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.winCountTotal + data.lossCountTotal);
-		}
+			appendNumber(output, data.winCountTotal + data.lossCountTotal);
+		},
+		isNeverEmpty
 	},
 	{
-		"winpercent", [](const PlayerData & data) -> std::string
+		"winpercent", [](const PlayerData & data, std::string & output)
 		{
 			int totalMatches = data.winCount + data.lossCount;
-			if (totalMatches == 0)
+			if (totalMatches != 0)
 			{
-				return "";
+				appendNumber(output, 0.01f * std::round(10000.f * float(data.winCount) / float(totalMatches)));
 			}
-			return cNtoS(0.01f * std::round(10000.f * float(data.winCount) / float(totalMatches)));
+		},
+		[](const PlayerData & data)
+		{
+			return data.winCount + data.lossCount != 0;
 		}
 	},
 	{
-		"winpercent%", [](const PlayerData & data) -> std::string
+		"winpercent%", [](const PlayerData & data, std::string & output)
 		{
 			int totalMatches = data.winCount + data.lossCount;
 			if (totalMatches == 0)
 			{
-				return "N/A";
+				output += "N/A";
+				return;
 			}
-			return cNtoS(0.01f * std::round(10000.f * float(data.winCount) / float(totalMatches))) + " %";
-		}
+			appendNumber(output, 0.01f * std::round(10000.f * float(data.winCount) / float(totalMatches)));
+			output += " %";
+		},
+		isNeverEmpty
 	},
 	{
-		"allycount", [](const PlayerData & data)
+		"allycount", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.prevAllyCount);
-		}
+			appendNumber(output, data.prevAllyCount);
+		},
+		isNeverEmpty
 	},
 	{
-		"enemycount", [](const PlayerData & data)
+		"enemycount", [](const PlayerData & data, std::string & output)
 		{
-			return cNtoS(data.prevEnemyCount);
-		}
+			appendNumber(output, data.prevEnemyCount);
+		},
+		isNeverEmpty
 	},
 };
 
-std::string PlayerData::format(const std::string & input) const
+static constexpr std::size_t expressionCount = sizeof(expressions) / sizeof(expressions[0]);
+
+// Returns the index of the expression with the specified lowercase name, or expressionCount if there is none.
+static std::size_t findExpression(const std::string & name)
 {
-	std::string output;
+	for (std::size_t i = 0; i < expressionCount; ++i)
+	{
+		if (name == expressions[i].name)
+		{
+			return i;
+		}
+	}
+	return expressionCount;
+}
+
+PlayerData::Template::Template()
+{
+}
+
+PlayerData::Template::Template(const std::string & input)
+{
+	std::string text;
 	std::string token;
 	bool readingToken = false;
 
@@ -229,32 +363,19 @@ std::string PlayerData::format(const std::string & input) const
 		{
 			if (input[i] == ']')
 			{
-				bool plural = false;
-				if (!token.empty() && token[0] == '$')
-				{
-					plural = true;
-				}
-
-				auto expr = expressions.find(plural ? token.substr(1) : token);
-				if (expr == expressions.end())
+				bool plural = (!token.empty() && token[0] == '$');
+				std::size_t expression = findExpression(plural ? token.substr(1) : token);
+				if (expression == expressionCount)
 				{
-					output += '[';
-					output += token;
-					output += "???]";
+					text += '[';
+					text += token;
+					text += "???]";
 				}
 				else
 				{
-					if (plural)
-					{
-						if (expr->second(*this) != "1")
-						{
-							output += "s";
-						}
-					}
-					else
-					{
-						output += expr->second(*this);
-					}
+					addLiteral(text);
+					text.clear();
+					tokens.push_back({plural ? Token::Plural : Token::Value, expression, 0});
 				}
 
 				readingToken = false;
@@ -273,35 +394,126 @@ std::string PlayerData::format(const std::string & input) const
 			}
 			else
 			{
-				output += input[i];
+				text += input[i];
 			}
 		}
 	}
 
-	return output;
+	addLiteral(text);
 }
 
-bool PlayerData::evaluate(const std::string & input) const
+void PlayerData::Template::render(const PlayerData & data, std::string & output) const
+{
+	output.clear();
+
+	for (const Token & token : tokens)
+	{
+		switch (token.type)
+		{
+		case Token::Literal:
+			output.append(literals, token.begin, token.length);
+			break;
+
+		case Token::Value:
+			expressions[token.begin].expression(data, output);
+			break;
+
+		case Token::Plural:
+		{
+			// The value is only needed for the comparison, so it is appended and removed again.
+			std::size_t valueBegin = output.size();
+			expressions[token.begin].expression(data, output);
+			bool singular = (output.size() == valueBegin + 1 && output[valueBegin] == '1');
+			output.resize(valueBegin);
+			if (!singular)
+			{
+				output += 's';
+			}
+			break;
+		}
+		}
+	}
+}
+
+void PlayerData::Template::addLiteral(const std::string & text)
 {
-	if (input.empty())
+	if (text.empty())
 	{
-		return true;
+		return;
 	}
 
-	auto tolowerString = [](std::string in)
+	tokens.push_back({Token::Literal, literals.size(), text.size()});
+	literals += text;
+}
+
+PlayerData::Condition::Condition()
+{
+}
+
+PlayerData::Condition::Condition(const std::string & input)
+{
+	auto trim = [](const std::string & string)
 	{
-		std::transform(in.begin(), in.end(), in.begin(), ::tolower);
-		return in;
+		std::size_t begin = string.find_first_not_of(" \t");
+		std::size_t end = string.find_last_not_of(" \t");
+		return begin == std::string::npos ? "" : string.substr(begin, end - begin + 1);
 	};
 
-	bool negate = (input[0] == '!');
-	bool expressionResult = false;
+	bool startsAlternative = false;
+	for (std::size_t begin = 0; begin <= input.size();)
+	{
+		std::size_t end = std::min(input.find_first_of("&|", begin), input.size());
+		std::string name = trim(input.substr(begin, end - begin));
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+		if (!name.empty())
+		{
+			bool negate = (name[0] == '!');
+			std::size_t expression = findExpression(negate ? trim(name.substr(1)) : name);
+			terms.push_back({expression, negate, startsAlternative && !terms.empty()});
+			startsAlternative = false;
+		}
 
-	auto expr = expressions.find(tolowerString(negate ? input.substr(1) : input));
-	if (expr != expressions.end())
+		if (end < input.size() && input[end] == '|')
+		{
+			startsAlternative = true;
+		}
+		begin = end + 1;
+	}
+}
+
+bool PlayerData::Condition::test(const PlayerData & data) const
+{
+	// True if all terms of any alternative are true.
+	bool alternativeResult = true;
+	for (const Term & term : terms)
 	{
-		expressionResult = !expr->second(*this).empty();
+		if (term.startsAlternative)
+		{
+			if (alternativeResult)
+			{
+				return true;
+			}
+			alternativeResult = true;
+		}
+
+		if (alternativeResult)
+		{
+			bool value = term.expression < expressionCount && expressions[term.expression].test(data);
+			alternativeResult = (value != term.negate);
+		}
 	}
+	return alternativeResult;
+}
 
-	return expressionResult != negate;
+std::string PlayerData::format(const std::string & input) const
+{
+	std::string output;
+	Template(input).render(*this, output);
+	return output;
+}
+
+bool PlayerData::evaluate(const std::string & input) const
+{
+	return Condition(input).test(*this);
 }
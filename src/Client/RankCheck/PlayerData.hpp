@@ -3,7 +3,9 @@
 
 #include <SFML/Config.hpp>
 #include <SFML/Network/IpAddress.hpp>
+#include <cstddef>
 #include <string>
+#include <vector>
 
 struct PlayerData
 {
@@ -62,6 +64,77 @@ struct PlayerData
 	int prevAllyCount = 0;
 	int prevEnemyCount = 0;
 
+	/**
+	 * A format string compiled into literal text and expression references.
+	 *
+	 * Compiling resolves every [token] once, so that rendering only copies literal text and appends expression values.
+	 */
+	class Template
+	{
+	public:
+
+		Template();
+		explicit Template(const std::string & input);
+
+		/**
+		 * Replaces the contents of the output with the template's text for the specified player.
+		 */
+		void render(const PlayerData & data, std::string & output) const;
+
+	private:
+
+		struct Token
+		{
+			enum Type
+			{
+				Literal,
+				Value,
+				Plural
+			};
+
+			Type type;
+
+			// Span in the literal text for literals, index of the expression otherwise.
+			std::size_t begin;
+			std::size_t length;
+		};
+
+		void addLiteral(const std::string & text);
+
+		std::string literals;
+		std::vector<Token> tokens;
+	};
+
+	/**
+	 * A condition compiled into references to expressions.
+	 *
+	 * A condition names an expression that must not be empty, optionally negated with '!'. Conditions can be combined
+	 * with '&' and '|', where '&' binds more tightly. An empty condition is always true.
+	 */
+	class Condition
+	{
+	public:
+
+		Condition();
+		explicit Condition(const std::string & input);
+
+		bool test(const PlayerData & data) const;
+
+	private:
+
+		struct Term
+		{
+			// Index of the expression, or the expression count for unknown expressions, which are always empty.
+			std::size_t expression;
+			bool negate;
+
+			// True if this term is combined with the previous ones by '|' rather than '&'.
+			bool startsAlternative;
+		};
+
+		std::vector<Term> terms;
+	};
+
 	std::string format(const std::string & input) const;
 	bool evaluate(const std::string & input) const;
 };
@@ -0,0 +1,290 @@
+#include <Client/RankCheck/PlayerTable.hpp>
+#include <Shared/Utils/Hash.hpp>
+#include <algorithm>
+#include <numeric>
+
+constexpr std::size_t PlayerTable::MAX_IP_COUNT;
+constexpr sf::Uint32 PlayerTable::NO_NAME;
+
+// Initial number of slots in each hash index. The indices are kept at most half full.
+static const std::size_t initialSlotCount = 64;
+
+static std::size_t hashSteamID(sf::Uint64 steamID)
+{
+	// Finalizer of SplitMix64. SteamIDs of different players mostly differ in their lower bits.
+	steamID ^= steamID >> 30;
+	steamID *= 0xbf58476d1ce4e5b9ull;
+	steamID ^= steamID >> 27;
+	steamID *= 0x94d049bb133111ebull;
+	steamID ^= steamID >> 31;
+	return steamID;
+}
+
+static std::size_t hashName(const std::string & name)
+{
+	return dataHash32(name.data(), name.size());
+}
+
+static void insertSlot(std::vector<sf::Uint32> & slots, std::size_t hash, sf::Uint32 value)
+{
+	std::size_t mask = slots.size() - 1;
+	std::size_t slot = hash & mask;
+	while (slots[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+	slots[slot] = value;
+}
+
+std::size_t PlayerTable::Record::getNameCount() const
+{
+	return firstName.name == NO_NAME ? 0 : 1 + otherNames.size();
+}
+
+const PlayerTable::NameCount & PlayerTable::Record::getName(std::size_t index) const
+{
+	return index == 0 ? firstName : otherNames[index - 1];
+}
+
+sf::Uint32 PlayerTable::Record::getRecentIP() const
+{
+	return ipCount == 0 ? 0 : ipAddresses[ipCount - 1];
+}
+
+void PlayerTable::Record::addIP(sf::Uint32 ip)
+{
+	auto end = ipAddresses.begin() + ipCount;
+	auto it = std::find(ipAddresses.begin(), end, ip);
+	if (it != end)
+	{
+		std::copy(it + 1, end, it);
+		ipCount--;
+	}
+	else if (ipCount == MAX_IP_COUNT)
+	{
+		std::copy(ipAddresses.begin() + 1, end, ipAddresses.begin());
+		ipCount--;
+	}
+
+	ipAddresses[ipCount++] = ip;
+}
+
+void PlayerTable::Record::clearStats()
+{
+	sponsorSteamID = 0;
+	allyCount = 0;
+	enemyCount = 0;
+	commonName = NameCount();
+	firstName = NameCount();
+	otherNames.clear();
+}
+
+bool PlayerTable::Record::operator==(const Record & other) const
+{
+	if (steamID != other.steamID || sponsorSteamID != other.sponsorSteamID || allyCount != other.allyCount
+		|| enemyCount != other.enemyCount || getNameCount() != other.getNameCount() || ipCount != other.ipCount)
+	{
+		return false;
+	}
+
+	for (std::size_t i = 0; i < getNameCount(); ++i)
+	{
+		if (getName(i).name != other.getName(i).name || getName(i).count != other.getName(i).count)
+		{
+			return false;
+		}
+	}
+
+	return std::equal(ipAddresses.begin(), ipAddresses.begin() + ipCount, other.ipAddresses.begin());
+}
+
+PlayerTable::PlayerTable() :
+	recordSlots(initialSlotCount, 0),
+	nameSlots(initialSlotCount, 0)
+{
+}
+
+PlayerTable::Record * PlayerTable::find(sf::Uint64 steamID)
+{
+	return const_cast<Record *>(static_cast<const PlayerTable *>(this)->find(steamID));
+}
+
+const PlayerTable::Record * PlayerTable::find(sf::Uint64 steamID) const
+{
+	std::size_t mask = recordSlots.size() - 1;
+	for (std::size_t slot = hashSteamID(steamID) & mask; recordSlots[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const Record & record = records[recordSlots[slot] - 1];
+		if (record.steamID == steamID)
+		{
+			return &record;
+		}
+	}
+	return nullptr;
+}
+
+PlayerTable::Record & PlayerTable::get(sf::Uint64 steamID)
+{
+	Record * existing = find(steamID);
+	if (existing)
+	{
+		return *existing;
+	}
+
+	if ((records.size() + 1) * 2 > recordSlots.size())
+	{
+		rebuildRecordSlots(recordSlots.size() * 2);
+	}
+
+	records.emplace_back();
+	records.back().steamID = steamID;
+	insertSlot(recordSlots, hashSteamID(steamID), records.size());
+	return records.back();
+}
+
+void PlayerTable::removeIf(std::function<bool(const Record & record)> predicate)
+{
+	std::size_t previousSize = records.size();
+	records.erase(std::remove_if(records.begin(), records.end(), predicate), records.end());
+	if (records.size() != previousSize)
+	{
+		rebuildRecordSlots(recordSlots.size());
+	}
+}
+
+std::size_t PlayerTable::size() const
+{
+	return records.size();
+}
+
+bool PlayerTable::empty() const
+{
+	return records.empty();
+}
+
+void PlayerTable::clear()
+{
+	records.clear();
+	recordSlots.assign(initialSlotCount, 0);
+	names.clear();
+	nameSlots.assign(initialSlotCount, 0);
+}
+
+void PlayerTable::clearStats()
+{
+	for (auto & record : records)
+	{
+		record.clearStats();
+	}
+}
+
+void PlayerTable::addName(Record & record, const std::string & name, sf::Uint32 count)
+{
+	if (name == "[unknown]" || name.empty())
+	{
+		return;
+	}
+
+	sf::Uint32 id = internName(name);
+
+	NameCount * entry = nullptr;
+	if (record.firstName.name == NO_NAME || record.firstName.name == id)
+	{
+		entry = &record.firstName;
+	}
+	else
+	{
+		for (auto & otherName : record.otherNames)
+		{
+			if (otherName.name == id)
+			{
+				entry = &otherName;
+				break;
+			}
+		}
+
+		if (entry == nullptr)
+		{
+			record.otherNames.emplace_back();
+			entry = &record.otherNames.back();
+		}
+	}
+
+	entry->name = id;
+	entry->count += count;
+
+	if (entry->count > record.commonName.count
+		|| (entry->count == record.commonName.count && isNameBefore(id, record.commonName.name)))
+	{
+		record.commonName = *entry;
+	}
+}
+
+const std::string & PlayerTable::getName(sf::Uint32 name) const
+{
+	static const std::string noName;
+	return name < names.size() ? names[name] : noName;
+}
+
+void PlayerTable::forEachSorted(std::function<void(const Record & record)> callback) const
+{
+	std::vector<sf::Uint32> order(records.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](sf::Uint32 index1, sf::Uint32 index2)
+	{
+		return records[index1].steamID < records[index2].steamID;
+	});
+
+	for (auto index : order)
+	{
+		callback(records[index]);
+	}
+}
+
+void PlayerTable::forEach(std::function<void(const Record & record)> callback) const
+{
+	for (auto & record : records)
+	{
+		callback(record);
+	}
+}
+
+sf::Uint32 PlayerTable::internName(const std::string & name)
+{
+	std::size_t hash = hashName(name);
+	std::size_t mask = nameSlots.size() - 1;
+	for (std::size_t slot = hash & mask; nameSlots[slot] != 0; slot = (slot + 1) & mask)
+	{
+		if (names[nameSlots[slot] - 1] == name)
+		{
+			return nameSlots[slot] - 1;
+		}
+	}
+
+	if ((names.size() + 1) * 2 > nameSlots.size())
+	{
+		nameSlots.assign(nameSlots.size() * 2, 0);
+		for (std::size_t i = 0; i < names.size(); ++i)
+		{
+			insertSlot(nameSlots, hashName(names[i]), i + 1);
+		}
+	}
+
+	names.push_back(name);
+	insertSlot(nameSlots, hash, names.size());
+	return names.size() - 1;
+}
+
+bool PlayerTable::isNameBefore(sf::Uint32 name1, sf::Uint32 name2) const
+{
+	return name2 == NO_NAME || (name1 != NO_NAME && names[name1] < names[name2]);
+}
+
+void PlayerTable::rebuildRecordSlots(std::size_t slotCount)
+{
+	recordSlots.assign(slotCount, 0);
+	for (std::size_t i = 0; i < records.size(); ++i)
+	{
+		insertSlot(recordSlots, hashSteamID(records[i].steamID), i + 1);
+	}
+}
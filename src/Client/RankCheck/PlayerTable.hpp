@@ -0,0 +1,120 @@
+#ifndef SRC_CLIENT_RANKCHECK_PLAYERTABLE_HPP_
+#define SRC_CLIENT_RANKCHECK_PLAYERTABLE_HPP_
+
+#include <SFML/Config.hpp>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Compact in-memory storage for per-player statistics, keyed by SteamID.
+ *
+ * Records are stored contiguously and found through an open-addressing hash index. Nicknames are interned in a pool
+ * shared by all records of the table, so each record only holds name indices, and IP addresses are kept in a fixed
+ * inline array. Most records therefore need no allocation at all. Iterating in SteamID order sorts the records on
+ * demand.
+ */
+class PlayerTable
+{
+public:
+
+	static constexpr std::size_t MAX_IP_COUNT = 10;
+	static constexpr sf::Uint32 NO_NAME = 0xFFFFFFFF;
+
+	struct NameCount
+	{
+		sf::Uint32 name = NO_NAME;
+		sf::Uint32 count = 0;
+	};
+
+	struct Record
+	{
+		sf::Uint64 steamID = 0;
+		sf::Uint64 sponsorSteamID = 0;
+		sf::Uint32 allyCount = 0;
+		sf::Uint32 enemyCount = 0;
+
+		// Most frequently used name; ties go to the name that sorts first, as in PlayerDB::EntryV0::getCommonName().
+		NameCount commonName;
+
+		// Most players only ever use a single name, which is stored inline.
+		NameCount firstName;
+		std::vector<NameCount> otherNames;
+
+		// Oldest address first.
+		std::array<sf::Uint32, MAX_IP_COUNT> ipAddresses;
+		sf::Uint8 ipCount = 0;
+
+		std::size_t getNameCount() const;
+		const NameCount & getName(std::size_t index) const;
+
+		sf::Uint32 getRecentIP() const;
+		void addIP(sf::Uint32 ip);
+
+		/**
+		 * Resets the statistics, keeping the IP addresses.
+		 */
+		void clearStats();
+
+		bool operator==(const Record & other) const;
+	};
+
+	PlayerTable();
+
+	Record * find(sf::Uint64 steamID);
+	const Record * find(sf::Uint64 steamID) const;
+
+	/**
+	 * Returns the record for a SteamID, adding an empty record if there is none.
+	 */
+	Record & get(sf::Uint64 steamID);
+
+	/**
+	 * Removes all records for which the specified function returns true.
+	 */
+	void removeIf(std::function<bool(const Record & record)> predicate);
+
+	std::size_t size() const;
+	bool empty() const;
+	void clear();
+
+	/**
+	 * Resets the statistics of all records, keeping their IP addresses.
+	 */
+	void clearStats();
+
+	/**
+	 * Adds count uses of a name to a record of this table. Empty and unknown names are ignored, as in
+	 * PlayerDB::EntryV0::addName().
+	 */
+	void addName(Record & record, const std::string & name, sf::Uint32 count = 1);
+	const std::string & getName(sf::Uint32 name) const;
+
+	/**
+	 * Calls the specified function for every record, in ascending SteamID order.
+	 */
+	void forEachSorted(std::function<void(const Record & record)> callback) const;
+
+	/**
+	 * Calls the specified function for every record, in no particular order.
+	 */
+	void forEach(std::function<void(const Record & record)> callback) const;
+
+private:
+
+	sf::Uint32 internName(const std::string & name);
+	bool isNameBefore(sf::Uint32 name1, sf::Uint32 name2) const;
+	void rebuildRecordSlots(std::size_t slotCount);
+
+	std::vector<Record> records;
+
+	// Indices into records plus one, zero for free slots. The size is always a power of two.
+	std::vector<sf::Uint32> recordSlots;
+
+	std::vector<std::string> names;
+	std::vector<sf::Uint32> nameSlots;
+};
+
+#endif
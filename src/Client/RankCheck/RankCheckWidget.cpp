@@ -30,7 +30,7 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
-#include <set>
+#include <unordered_set>
 #include <utility>
 
 static cfg::Bool disappearSimultaneously("rankcheck.playerPopups.disappearSimultaneously");
@@ -45,12 +45,47 @@ static cfg::Float ratingHistoryAnimTime("rankcheck.ratingHistory.animationTime")
 static cfg::Int maxRatingCount("rankcheck.ratingHistory.bufferSize");
 static cfg::Float ratingHistorySpace("rankcheck.ratingHistory.verticalSpace");
 
-RankCheckWidget::RankCheckWidget()
+static const std::size_t maxLogEventsPerTick = 64;
+
+// Number of online lookups running at the same time; further lookups are queued.
+static const std::size_t maxLookupThreads = 4;
+
+// Maximum number of finished matches waiting to be merged into a player database rebuild.
+static const std::size_t maxLiveReplays = 64;
+
+// Minimum time between two states of an incremental rebuild shown by the UI thread. Each published state costs the
+// rebuild thread a copy of the changes made so far.
+static const sf::Time buildSnapshotInterval = sf::seconds(2);
+
+// Adds the players of a replay to the database, unless the replay is already known to it. Returns true if the replay
+// was added.
+static bool addReplayToDB(PlayerDB & db, const ReplayParser::ReplayInfo & info)
+{
+	if (!info.countStats || db.hasReplayHash(info.hash))
+	{
+		return false;
+	}
+
+	db.addReplayHash(info.hash);
+	for (const auto & player : info.players)
+	{
+		db.addPlayerToStats(player.player, info.localTeam, player.sponsor.steamID);
+	}
+	return true;
+}
+
+RankCheckWidget::RankCheckWidget() :
+	lookupPool(maxLookupThreads),
+	checker(httpClient, lookupPool),
+	usernameLookup(httpClient, lookupPool),
+	countryLookup(httpClient, lookupPool),
+	playerDBLiveReplays(maxLiveReplays)
 {
 	playerDBBuildRunning = false;
 	playerDBBuildDone = false;
 	playerDBBuildDirCount = 0;
 	playerDBBuildProgress = 0;
+	playerDBCompactionDone = false;
 
 	currentScore.setTotal(true);
 
@@ -72,24 +107,43 @@ RankCheckWidget::RankCheckWidget()
 
 	setComplexOverride(true);
 
-	initGameCallbacks();
 	initGuiCallbacks();
 }
 
 RankCheckWidget::~RankCheckWidget()
 {
-	if (playerDBBuildRunning)
+	if (playerDBCompactionThread.joinable())
 	{
-		playerDBBuildThread.join();
-		playerDB = playerDBAsync;
+		playerDBCompactionThread.join();
+		if (!playerDBBuildRunning)
+		{
+			finishPlayerDBCompaction();
+		}
 	}
 
 	try
 	{
-		if (!playerDB.empty())
+		if (playerDBBuildRunning)
+		{
+			playerDBBuildThread.join();
+			playerDB = std::move(playerDBAsync);
+			playerDBSaveRequested = true;
+
+			ReplayParser::ReplayInfo info;
+			while (playerDBLiveReplays.pop(info))
+			{
+				addReplayToDB(playerDB, info);
+			}
+		}
+
+		if (playerDBSaveRequested && !playerDB.empty())
 		{
 			playerDB.save();
 		}
+		else
+		{
+			playerDB.flushJournal();
+		}
 	}
 	catch (std::exception & ex)
 	{
@@ -150,19 +204,11 @@ void RankCheckWidget::initGuiCallbacks()
 	});
 }
 
-void RankCheckWidget::initGameCallbacks()
+void RankCheckWidget::handleLogEvent(const LogMonitor::Event & event)
 {
-	replayWatcher.setReplayStartCallback([=](std::string replayPath)
+	switch (event.type)
 	{
-		currentReplayPath = replayPath;
-	});
-
-	netlogReader.setCallbackStart([=]()
-	{
-		persistentReader.resetPlayers();
-		persistentReader.markMatchStart();
-		persistentReader.saveState(config());
-
+	case LogMonitor::Event::SessionStart:
 		localTeam = PlayerData::UnknownTeam;
 		pendingCards.clear();
 		for (auto & card : playerCards)
@@ -170,35 +216,43 @@ void RankCheckWidget::initGameCallbacks()
 			card->kill();
 		}
 		loadFont();
-	});
+		break;
 
-	netlogReader.setCallbackEnd([=]()
-	{
+	case LogMonitor::Event::SessionEnd:
+		// The cards waiting for these lookups are gone.
 		pendingCards.clear();
-		flushCurrentReplayDataToStats();
-	});
+		checker.cancel();
+		usernameLookup.cancel();
+		countryLookup.cancel();
+		checker.saveCache();
+		usernameLookup.saveCache();
+		countryLookup.saveCache();
+		break;
 
-	persistentReader.setPlayerCallback([=](sf::Uint64 steamID)
+	case LogMonitor::Event::PlayerJoined:
 	{
-		if (steamID == 0)
-		{
-			steamID = netlogReader.getLocalSteamID();
-		}
-
 		PlayerData player;
-		player.steamID = steamID;
+		player.steamID = event.steamID;
 		player.ip = sf::IpAddress::None;
 		player.team = PlayerData::Blue;
-		player.isLocal = (netlogReader.getLocalSteamID() == player.steamID);
+		player.isLocal = event.isLocal;
 		playerDB.fillPlayerData(player);
 		queuePlayerCard(player);
-	});
+		break;
+	}
 
-	persistentReader.setRatingCallback([=](sf::Int64 diff)
-	{
-		queueRatingDiff(diff);
-		currentScore.setValue(persistentReader.getCurrentRating());
-	});
+	case LogMonitor::Event::RatingUploaded:
+		queueRatingDiff(event.ratingDiff);
+		currentScore.setValue(event.rating);
+		break;
+
+	case LogMonitor::Event::ReplayFound:
+		if (event.replay)
+		{
+			addReplayDataToStats(*event.replay);
+		}
+		break;
+	}
 }
 
 void RankCheckWidget::handleConfigChange()
@@ -208,16 +262,25 @@ void RankCheckWidget::handleConfigChange()
 	static cfg::String lbUriPrefix("rankcheck.servers.leaderboard.uriPrefix");
 	static cfg::String lbUriSeparator("rankcheck.servers.leaderboard.separator");
 	static cfg::String lbUriSuffix("rankcheck.servers.leaderboard.uriSuffix");
+	static cfg::Int lbUpdateInterval("rankcheck.leaderboardUpdateInterval");
+	static cfg::Bool lbPersistentCache("rankcheck.persistentLeaderboardCache");
 
 	static cfg::String nameHost("rankcheck.servers.username.host");
 	static cfg::Int namePort("rankcheck.servers.username.port");
 	static cfg::String nameUriPrefix("rankcheck.servers.username.uriPrefix");
+	static cfg::String nameUriSeparator("rankcheck.servers.username.separator");
 	static cfg::String nameUriSuffix("rankcheck.servers.username.uriSuffix");
 
 	static cfg::String ctryHost("rankcheck.servers.country.host");
 	static cfg::Int ctryPort("rankcheck.servers.country.port");
 	static cfg::String ctryUriPrefix("rankcheck.servers.country.uriPrefix");
 	static cfg::String ctryUriSuffix("rankcheck.servers.country.uriSuffix");
+	static cfg::Bool ctryUseTable("rankcheck.offlineCountries");
+	static cfg::Bool ctryOnlineFallback("rankcheck.onlineCountryFallback");
+
+	static cfg::Float requestTimeout("rankcheck.requestTimeout");
+	static cfg::Int requestRetries("rankcheck.requestRetries");
+	static cfg::Float requestRetryDelay("rankcheck.requestRetryDelay");
 
 	NautsNames::getInstance().initWithConfig(config());
 	try
@@ -236,19 +299,23 @@ void RankCheckWidget::handleConfigChange()
 	{
 		needStartupNetlog = false;
 		readStartupNetlog(playerDB);
+		flushPlayerDB();
 	}
 
 	LeagueReader::getInstance().initWithConfig(config());
+	httpClient.setTimeout(sf::seconds(config().get(requestTimeout)));
+	httpClient.setRetryParameters(std::max<cfg::Int::DataType>(config().get(requestRetries), 0),
+		sf::seconds(config().get(requestRetryDelay)));
 	checker.setHost(config().get(lbHost), config().get(lbPort));
 	checker.setUriParameters(config().get(lbUriPrefix), config().get(lbUriSeparator), config().get(lbUriSuffix));
+	checker.setCacheParameters(config().get(lbUpdateInterval) * 60, config().get(lbPersistentCache));
 	usernameLookup.setHost(config().get(nameHost), config().get(namePort));
-	usernameLookup.setUriParameters(config().get(nameUriPrefix), config().get(nameUriSuffix));
+	usernameLookup.setUriParameters(config().get(nameUriPrefix), config().get(nameUriSeparator),
+		config().get(nameUriSuffix));
 	countryLookup.setHost(config().get(ctryHost), config().get(ctryPort));
 	countryLookup.setUriParameters(config().get(ctryUriPrefix), config().get(ctryUriSuffix));
-	replayWatcher.initWithConfig(config());
-	netlogReader.initWithConfig(config());
-	gamelogReader.initWithConfig(config());
-	persistentReader.initWithConfig(config());
+	countryLookup.setOfflineParameters(config().get(ctryUseTable), config().get(ctryOnlineFallback));
+	logMonitor.initWithConfig(config());
 
 	for (auto & card : playerCards)
 	{
@@ -268,15 +335,57 @@ void RankCheckWidget::handleConfigChange()
 
 void RankCheckWidget::handleTick()
 {
+	if (playerDBBuildRunning && !playerDBBuildDone)
+	{
+		// Copying the published state is cheap, since the copy shares its data with the rebuild thread's snapshot.
+		std::shared_ptr<const PlayerDB> snapshot = std::atomic_exchange(&playerDBBuildSnapshot,
+			std::shared_ptr<const PlayerDB>());
+		if (snapshot)
+		{
+			playerDB = *snapshot;
+			updateAllPlayerCards();
+		}
+	}
+
 	if (playerDBBuildDone)
 	{
 		playerDBBuildDone = false;
 		playerDBBuildRunning = false;
 		playerDBBuildThread.detach();
 		playerDBBuildSuccessTimer.restart(sf::seconds(10));
-		playerDB = playerDBAsync;
-		playerDB.save();
+
+		// Swapping in the rebuilt database only exchanges pointers. It is written to disk by a compaction, once a
+		// compaction started before the rebuild, which is outdated now, has finished.
+		playerDB = std::move(playerDBAsync);
+		playerDB.setJournaling(true);
+		playerDBSaveRequested = true;
+		playerDBCompactionOutdated = (playerDBCompaction != nullptr);
+		std::atomic_store(&playerDBBuildSnapshot, std::shared_ptr<const PlayerDB>());
+
+		// Matches finished after the rebuild thread's last look at the queue are added like any other match.
+		ReplayParser::ReplayInfo info;
+		while (playerDBLiveReplays.pop(info))
+		{
+			addReplayDataToStats(info);
+		}
 		updateAllPlayerCards();
+
+		playerDBBuildSummary = "Player database was built successfully!\n"
+			"Number of unique matches: " + cNtoS(playerDB.getReplayHashCount()) + "\n"
+			"Number of unique players: " + cNtoS(playerDB.getPlayerCount());
+	}
+
+	// Compactions finishing during a rebuild are only handled once the rebuild is done.
+	if (playerDBCompactionDone && !playerDBBuildRunning)
+	{
+		playerDBCompactionThread.join();
+		finishPlayerDBCompaction();
+	}
+
+	if (playerDBSaveRequested && !playerDBCompaction)
+	{
+		playerDBSaveRequested = false;
+		startPlayerDBCompaction();
 	}
 
 	if (gameDirChooser.isDone())
@@ -325,20 +434,21 @@ void RankCheckWidget::handleTick()
 		card->autoShow();
 	}
 
-	netlogReader.process();
-	gamelogReader.process();
-	persistentReader.setLocalSteamID(netlogReader.getLocalSteamID());
-	persistentReader.process();
-	countryLookup.process();
-	usernameLookup.process();
-	replayWatcher.process();
-	checker.setLocalSteamID(netlogReader.getLocalSteamID());
+	// Only handle a limited number of log events per tick, so that a burst of events cannot stall the UI.
+	LogMonitor::Event logEvent;
+	for (std::size_t i = 0; i < maxLogEventsPerTick && logMonitor.pollEvent(logEvent); ++i)
+	{
+		handleLogEvent(logEvent);
+	}
+
+	checker.setLocalSteamID(logMonitor.getLocalSteamID());
 	checker.sendRequestIfNeeded();
-	checker.process();
+	usernameLookup.sendRequestIfNeeded();
+	lookupPool.processCallbacks();
 
-	if (persistentReader.checkStateSaveRequest())
+	if (logMonitor.checkStateSaveRequest())
 	{
-		persistentReader.saveState(config());
+		logMonitor.saveState(config());
 	}
 
 	playerCards.erase(std::remove_if(playerCards.begin(), playerCards.end(),
@@ -347,7 +457,7 @@ void RankCheckWidget::handleTick()
 				return card->done();
 			}), playerCards.end());
 
-	if (forceInstantCardDisplay || (gamelogReader.isInGame() && netlogReader.isSessionActive()))
+	if (forceInstantCardDisplay || (logMonitor.isInGame() && logMonitor.isSessionActive()))
 	{
 		for (auto it = pendingCards.begin(); it != pendingCards.end(); )
 		{
@@ -504,40 +614,27 @@ void RankCheckWidget::ask(std::string title, std::string question, std::function
 void RankCheckWidget::dumpSharedAccounts()
 {
 	debug() << "Shared accounts:";
-	std::map<sf::IpAddress, std::vector<sf::Uint64> > ips;
-	std::set<sf::IpAddress> multiIPs;
-	for (auto it = playerDB.getEntries().begin(); it != playerDB.getEntries().end(); ++it)
-	{
-		for (auto ip : it->second.ipAddresses)
-		{
-			ips[ip].push_back(it->first);
-			if (ips[ip].size() > 1)
-			{
-				multiIPs.insert(ip);
-			}
-		}
-	}
-	for (auto ip : multiIPs)
+	playerDB.forEachSharedIP([&](sf::IpAddress ip, const std::vector<sf::Uint64> & steamIDs)
 	{
 		auto d = debug();
-		for (auto steamID : ips[ip])
+		for (auto steamID : steamIDs)
 		{
 			d << userToString(steamID) << " ";
 		}
-	}
+	});
 	debug();
 }
 
 void RankCheckWidget::dumpSponsoredAccounts()
 {
 	debug() << "Sponsored accounts:";
-	for (auto it = playerDB.getEntries().begin(); it != playerDB.getEntries().end(); ++it)
+	playerDB.forEachEntry([&](sf::Uint64 steamID, const PlayerDB::EntryV2 & entry)
 	{
-		if (it->second.sponsorSteamID != 0)
+		if (entry.sponsorSteamID != 0)
 		{
-			debug() << userToString(it->first) << " " << userToString(it->second.sponsorSteamID);
+			debug() << userToString(steamID) << " " << userToString(entry.sponsorSteamID);
 		}
-	}
+	});
 	debug();
 }
 
@@ -553,10 +650,8 @@ std::string RankCheckWidget::userToString(sf::Uint64 steamID) const
 	}
 }
 
-void RankCheckWidget::rebuildPlayerDB()
+void RankCheckWidget::rebuildPlayerDB(bool fromScratch)
 {
-	playerDB.clear();
-
 	if (!playerDBBuildRunning)
 	{
 		static cfg::Int replayFoldersLength("rankcheck.awesomenauts.replayFolders.length");
@@ -582,74 +677,285 @@ void RankCheckWidget::rebuildPlayerDB()
 		}
 		else
 		{
+			// The copy shares the database's data; changes made by the rebuild thread do not affect playerDB.
 			playerDBAsync = playerDB;
+			playerDBAsync.setJournaling(false);
 
 			playerDBBuildProgress = 0;
 			playerDBBuildDirCount = 0;
 			playerDBBuildDone = false;
 			playerDBBuildRunning = true;
-			playerDBBuildThread = std::thread([this]()
+			playerDBBuildThread = std::thread([this,fromScratch]()
 			{
+				// Without a record of the replays read by the last build, the database is built from scratch.
+				ReplayManifest previousManifest;
+				playerDBBuildIncremental = !fromScratch && previousManifest.load();
+				if (!playerDBBuildIncremental)
+				{
+					playerDBAsync.clear();
+				}
+				playerDBBuildSnapshotClock.restart();
+
+				ReplayManifest manifest;
 				for (const auto & folder : playerDBReplayFolders)
 				{
-					rebuildPlayerDBFromDirectory(folder);
+					rebuildPlayerDBFromDirectory(folder, previousManifest, manifest);
 				}
+				updatePlayerDBBuild();
 				readStartupNetlog(playerDBAsync);
+				manifest.save();
 				playerDBBuildDone = true;
 			});
 		}
 	}
 }
 
-bool RankCheckWidget::rebuildPlayerDBFromDirectory(std::string directory)
+// Adds the players of a replay to the database, unless the replay is already known to it or contained in knownHashes.
+static ReplayParser::ReplayInfo ingestReplay(PlayerDB & db, const std::string & replayFile,
+	const std::unordered_set<ReplayParser::ReplayInfo::Hash> & knownHashes)
 {
+	ReplayParser parser(replayFile);
+	ReplayParser::ReplayInfo info = parser.parse();
+	if (knownHashes.count(info.hash) == 0)
+	{
+		addReplayToDB(db, info);
+	}
+	return info;
+}
+
+bool RankCheckWidget::rebuildPlayerDBFromDirectory(std::string directory, const ReplayManifest & previousManifest,
+	ReplayManifest & manifest)
+{
+	// Number of consecutive replays parsed into a single partial database.
+	static const std::size_t chunkSize = 32;
+
 	if (!isDirectory(directory))
 	{
 		return false;
 	}
 
+	std::vector<std::string> allDirs;
+	listDirectories(directory, allDirs, false, true);
+
+	// Skip replays whose file is unchanged since the last build, unless their replay is missing from the database.
 	std::vector<std::string> dirs;
-	listDirectories(directory, dirs, false, true);
+	std::vector<ReplayManifest::Entry> dirEntries;
+	for (const auto & dir : allDirs)
+	{
+		std::string replayDir = directory + "/" + dir;
+		ReplayManifest::Entry entry;
+		if (!ReplayManifest::readFileInfo(replayDir + "/Replays.info", entry))
+		{
+			continue;
+		}
+
+		const ReplayManifest::Entry * previousEntry = previousManifest.getEntry(replayDir);
+		if (previousEntry != nullptr && previousEntry->hasSameFileInfo(entry)
+			&& (!previousEntry->countStats || playerDBAsync.hasReplayHash(previousEntry->hash)))
+		{
+			manifest.setEntry(replayDir, *previousEntry);
+		}
+		else
+		{
+			dirs.push_back(dir);
+			dirEntries.push_back(entry);
+		}
+	}
 
 	playerDBBuildProgress = 0;
 	playerDBBuildDirCount = dirs.size();
 
-	for (std::string dir : dirs)
+	// The replays are split into chunks, which the workers claim one at a time and parse into a partial database each.
+	// Completed chunks are merged into the result in their original order, which makes the result identical to that of
+	// parsing all replays sequentially.
+	const std::unordered_set<ReplayParser::ReplayInfo::Hash> knownHashes = playerDBAsync.getReplayHashes();
+	const std::unordered_set<ReplayParser::ReplayInfo::Hash> noHashes;
+	const std::size_t chunkCount = (dirs.size() + chunkSize - 1) / chunkSize;
+	std::atomic<std::size_t> nextChunk(0);
+
+	std::mutex mergeMutex;
+	std::map<std::size_t, PlayerDB> completedChunks;
+	std::size_t nextMergedChunk = 0;
+
+	auto mergeChunk = [&](std::size_t chunk, const PlayerDB & partialDB)
+	{
+		bool hasDuplicates = false;
+		for (const auto & hash : partialDB.getReplayHashes())
+		{
+			if (playerDBAsync.hasReplayHash(hash))
+			{
+				hasDuplicates = true;
+				break;
+			}
+		}
+
+		if (hasDuplicates)
+		{
+			// A replay in this chunk was already added by an earlier chunk. The partial database cannot tell which of
+			// its entries stem from that replay, so the chunk is parsed again directly into the result.
+			std::size_t end = std::min(dirs.size(), (chunk + 1) * chunkSize);
+			for (std::size_t i = chunk * chunkSize; i < end; ++i)
+			{
+				ingestReplay(playerDBAsync, directory + "/" + dirs[i] + "/Replays.info", noHashes);
+			}
+		}
+		else
+		{
+			playerDBAsync.merge(partialDB);
+		}
+	};
+
+	auto worker = [&]()
 	{
-		ReplayParser parser(directory + "/" + dir + "/Replays.info");
-		ReplayParser::ReplayInfo info = parser.parse();
-		if (info.countStats && !playerDBAsync.hasReplayHash(info.hash))
+		std::size_t chunk;
+		while ((chunk = nextChunk++) < chunkCount)
 		{
-			playerDBAsync.addReplayHash(info.hash);
-			for (const auto & player : info.players)
+			PlayerDB partialDB;
+			std::size_t end = std::min(dirs.size(), (chunk + 1) * chunkSize);
+			for (std::size_t i = chunk * chunkSize; i < end; ++i)
 			{
-				playerDBAsync.addPlayerToStats(player.player, info.localTeam, player.sponsor.steamID);
+				ReplayParser::ReplayInfo info = ingestReplay(partialDB, directory + "/" + dirs[i] + "/Replays.info",
+					knownHashes);
+				dirEntries[i].countStats = info.countStats;
+				dirEntries[i].hash = info.hash;
+				playerDBBuildProgress++;
 			}
+
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			completedChunks.emplace(chunk, std::move(partialDB));
+			for (auto it = completedChunks.find(nextMergedChunk); it != completedChunks.end();
+				it = completedChunks.find(nextMergedChunk))
+			{
+				mergeChunk(it->first, it->second);
+				completedChunks.erase(it);
+				nextMergedChunk++;
+			}
+			updatePlayerDBBuild();
 		}
-		playerDBBuildProgress++;
+	};
+
+	std::size_t workerCount = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), chunkCount);
+	std::vector<std::thread> workers;
+	for (std::size_t i = 1; i < workerCount; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto & thread : workers)
+	{
+		thread.join();
+	}
+
+	for (std::size_t i = 0; i < dirs.size(); ++i)
+	{
+		manifest.setEntry(directory + "/" + dirs[i], dirEntries[i]);
 	}
 
 	return true;
 }
 
-void RankCheckWidget::flushCurrentReplayDataToStats()
+void RankCheckWidget::updatePlayerDBBuild()
 {
-	if (!currentReplayPath.empty())
+	// Matches finished during the rebuild are merged as soon as possible, so they are part of every published state.
+	// Their replay files may be parsed by the rebuild later on, but the replay hash prevents counting them twice.
+	ReplayParser::ReplayInfo info;
+	while (playerDBLiveReplays.pop(info))
+	{
+		addReplayToDB(playerDBAsync, info);
+	}
+
+	// A rebuild from scratch is only shown once complete, since its partial state lacks most of the database.
+	if (playerDBBuildIncremental && playerDBBuildSnapshotClock.getElapsedTime() >= buildSnapshotInterval)
 	{
-		ReplayParser parser(currentReplayPath + "/Replays.info");
-		ReplayParser::ReplayInfo info = parser.parse();
-		if (info.countStats && !playerDB.hasReplayHash(info.hash))
+		std::atomic_store(&playerDBBuildSnapshot, std::shared_ptr<const PlayerDB>(std::make_shared<PlayerDB>(
+			playerDBAsync)));
+		playerDBBuildSnapshotClock.restart();
+	}
+}
+
+void RankCheckWidget::addReplayDataToStats(const ReplayParser::ReplayInfo & info)
+{
+	if (playerDBBuildRunning)
+	{
+		// playerDB is replaced once the rebuild is done, so the rebuild thread merges the match into its database.
+		if (info.countStats && !playerDBLiveReplays.push(info))
 		{
-			playerDB.addReplayHash(info.hash);
-			for (const auto & player : info.players)
-			{
-				debug() << "Adding player to stats: " << player.player.currentName;
-				playerDB.addPlayerToStats(player.player, info.localTeam, player.sponsor.steamID);
-			}
+			debug() << "Too many matches waiting for the player database rebuild, not adding match to stats.";
 		}
+		return;
+	}
 
-		updateAllPlayerCards();
+	if (info.countStats && !playerDB.hasReplayHash(info.hash))
+	{
+		playerDB.addReplayHash(info.hash);
+		for (const auto & player : info.players)
+		{
+			debug() << "Adding player to stats: " << player.player.currentName;
+			playerDB.addPlayerToStats(player.player, info.localTeam, player.sponsor.steamID);
+		}
+		flushPlayerDB();
+	}
+
+	updateAllPlayerCards();
+}
+
+void RankCheckWidget::flushPlayerDB()
+{
+	static cfg::Int compactionSize("rankcheck.playerDBCompactionSize");
+
+	try
+	{
+		playerDB.flushJournal();
+	}
+	catch (std::exception & ex)
+	{
+		debug() << ex.what();
+	}
+
+	if (!playerDBBuildRunning && !playerDBCompaction && playerDB.needsCompaction(config().get(compactionSize)))
+	{
+		startPlayerDBCompaction();
+	}
+}
+
+void RankCheckWidget::startPlayerDBCompaction()
+{
+	try
+	{
+		playerDBCompaction = playerDB.startCompaction();
+		playerDBCompactionDone = false;
+		playerDBCompactionOutdated = false;
+		playerDBCompactionThread = std::thread([this]()
+		{
+			playerDBCompaction->run();
+			playerDBCompactionDone = true;
+		});
+	}
+	catch (std::exception & ex)
+	{
+		debug() << ex.what();
+		playerDBCompaction.reset();
+	}
+}
+
+void RankCheckWidget::finishPlayerDBCompaction()
+{
+	playerDBCompactionDone = false;
+
+	try
+	{
+		if (!playerDBCompactionOutdated)
+		{
+			playerDB.finishCompaction(*playerDBCompaction);
+		}
+	}
+	catch (std::exception & ex)
+	{
+		debug() << ex.what();
 	}
+
+	playerDBCompaction.reset();
+	playerDBCompactionOutdated = false;
 }
 
 bool RankCheckWidget::updatePlayerCard(PlayerData data)
@@ -676,6 +982,7 @@ void RankCheckWidget::queueOrUpdatePlayerCard(PlayerData data)
 	if (!updatePlayerCard(data))
 	{
 		pendingCards.push_back( { false, data, {} });
+		prefetchPlayerData(data);
 	}
 }
 
@@ -683,6 +990,7 @@ void RankCheckWidget::queuePlayerCard(PlayerData data)
 {
 	noMatchStartedYet = false;
 	pendingCards.push_back( { false, data, {} });
+	prefetchPlayerData(data);
 }
 
 void RankCheckWidget::queuePlayerCard(PlayerData main, PlayerData alt)
@@ -690,9 +998,71 @@ void RankCheckWidget::queuePlayerCard(PlayerData main, PlayerData alt)
 	noMatchStartedYet = false;
 	alt.type = PlayerData::Player;
 	pendingCards.push_back( { false, alt, {} });
+	prefetchPlayerData(alt);
 	//pendingCards.push_back( { true, main, alt });
 }
 
+void RankCheckWidget::prefetchPlayerData(const PlayerData & data)
+{
+	if (data.steamID == 0)
+	{
+		return;
+	}
+
+	sf::Uint64 steamID = data.steamID;
+
+	usernameLookup.lookup(steamID, [this,steamID](std::string username)
+	{
+		updatePendingCards(steamID, [&](PlayerData & pd)
+		{
+			pd.currentName = username;
+		});
+	});
+
+	if (config().get(loadLeaderboards))
+	{
+		checker.addSteamIDRequest(steamID, [this,steamID](RankChecker::Result result)
+		{
+			// Failures are left to the card's own request, which is repeated unless the result was cached.
+			if (result.code == RankChecker::Result::Success)
+			{
+				updatePendingCards(steamID, [&](PlayerData & pd)
+				{
+					updatePlayerDataFromLeaderboards(pd, result);
+				});
+			}
+		});
+		needRankRequest = true;
+	}
+
+	// Remote players are usually queued before their address is known, and looking up no address gives no country.
+	if (config().get(loadCountries) && (data.isLocal || data.ip != sf::IpAddress::None))
+	{
+		countryLookup.lookup(data.isLocal ? sf::IpAddress::LocalHost : data.ip, [this,steamID](std::string countryCode)
+		{
+			updatePendingCards(steamID, [&](PlayerData & pd)
+			{
+				setCountry(pd, countryCode);
+			});
+		});
+	}
+}
+
+void RankCheckWidget::updatePendingCards(sf::Uint64 steamID, std::function<void(PlayerData &)> update)
+{
+	for (auto & pc : pendingCards)
+	{
+		if (pc.main.steamID == steamID)
+		{
+			update(pc.main);
+		}
+		if (pc.hasAlt && pc.alt.steamID == steamID)
+		{
+			update(pc.alt);
+		}
+	}
+}
+
 bool RankCheckWidget::showPlayerCard(PlayerData data)
 {
 	auto card = createPlayerCard(data, false);
@@ -830,16 +1200,32 @@ bool RankCheckWidget::isSlotFree(int slot) const
 	return true;
 }
 
-void RankCheckWidget::requestPlayerDBRebuild()
+void RankCheckWidget::requestPlayerDBRebuild(bool fromScratch)
 {
-	ask("Rebuild player database",
-		"Do you wish to rebuild the player database?\n\n"
-		"This recalculates the number of ally/enemy\n"
-		"encounters and previously used nicknames.",
-		[=]()
-		{
-			rebuildPlayerDB();
-		});
+	if (fromScratch)
+	{
+		ask("Rebuild player database",
+			"Do you wish to rebuild the player database from scratch?\n\n"
+			"This clears the database and reads the number of\n"
+			"ally/enemy encounters and previously used nicknames\n"
+			"from all replays again. Stats of deleted replays are lost.",
+			[=]()
+			{
+				rebuildPlayerDB(true);
+			});
+	}
+	else
+	{
+		ask("Rebuild player database",
+			"Do you wish to rebuild the player database?\n\n"
+			"This reads the number of ally/enemy encounters\n"
+			"and previously used nicknames from all replays\n"
+			"that were added or changed since the last build.",
+			[=]()
+			{
+				rebuildPlayerDB();
+			});
+	}
 }
 
 float RankCheckWidget::getPlayerDBBuildProgressVisibility() const
@@ -863,9 +1249,7 @@ std::string RankCheckWidget::getPlayerDBBuildProgress() const
 	}
 	else if (!playerDBBuildSuccessTimer.expired())
 	{
-		return "Player database was built successfully!\n"
-			"Number of unique matches: " + cNtoS(playerDB.getReplayHashCount()) + "\n"
-			"Number of unique players: " + cNtoS(playerDB.getPlayerCount());
+		return playerDBBuildSummary;
 	}
 	else
 	{
@@ -920,17 +1304,22 @@ void RankCheckWidget::lookupCountryForCard(std::shared_ptr<PlayerCard> card)
 		countryLookup.lookup(ip, [this,card](std::string countryCode)
 		{
 			PlayerData pd = card->getPlayerData();
-			pd.countryCode = countryCode;
-			pd.country = config().get(cfg::String("countries." + countryCode));
-			if (pd.country.empty())
-			{
-				pd.country = config().get(cfg::String("countries.XX"));
-			}
+			setCountry(pd, countryCode);
 			card->setPlayerData(pd);
 		});
 	}
 }
 
+void RankCheckWidget::setCountry(PlayerData & playerData, const std::string & countryCode)
+{
+	playerData.countryCode = countryCode;
+	playerData.country = config().get(cfg::String("countries." + countryCode));
+	if (playerData.country.empty())
+	{
+		playerData.country = config().get(cfg::String("countries.XX"));
+	}
+}
+
 void RankCheckWidget::updateAllPlayerCards()
 {
 	for (auto card : playerCards)
@@ -1046,14 +1435,14 @@ void RankCheckWidget::reshowPlayers()
 
 	pendingCards.clear();
 
-	const auto & playerList = persistentReader.getCurrentPlayers().empty() ?
-		persistentReader.getPreviousPlayers() : persistentReader.getCurrentPlayers();
+	const auto playerList = logMonitor.getLatestPlayers();
+	const sf::Uint64 localSteamID = logMonitor.getLocalSteamID();
 
 	for (auto steamID : playerList)
 	{
 		if (steamID == 0)
 		{
-			steamID = netlogReader.getLocalSteamID();
+			steamID = localSteamID;
 		}
 
 		PlayerData player;
@@ -1068,7 +1457,7 @@ void RankCheckWidget::reshowPlayers()
 		}
 		//player.ip = info.ip;
 		player.team = PlayerData::Blue;
-		player.isLocal = (netlogReader.getLocalSteamID() == player.steamID);
+		player.isLocal = (localSteamID == player.steamID);
 		playerDB.fillPlayerData(player);
 		queueOrUpdatePlayerCard(player);
 	}
@@ -1080,7 +1469,7 @@ void RankCheckWidget::reshowPlayers()
 		{
 			if (steamID == 0)
 			{
-				steamID = netlogReader.getLocalSteamID();
+				steamID = localSteamID;
 			}
 
 			if (steamID == card->getPlayerData().steamID)
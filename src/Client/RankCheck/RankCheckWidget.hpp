@@ -3,14 +3,14 @@
 
 #include <Client/GUI3/Widget.hpp>
 #include <Client/RankCheck/CountryLookup.hpp>
-#include <Client/RankCheck/GameLogReader.hpp>
-#include <Client/RankCheck/NetworkLogReader.hpp>
-#include <Client/RankCheck/PersistentLogReader.hpp>
+#include <Client/RankCheck/HttpClient.hpp>
+#include <Client/RankCheck/LogMonitor.hpp>
 #include <Client/RankCheck/PlayerData.hpp>
 #include <Client/RankCheck/PlayerDB.hpp>
 #include <Client/RankCheck/RankChecker.hpp>
 #include <Client/RankCheck/RatingHistoryEntry.hpp>
-#include <Client/RankCheck/ReplayWatcher.hpp>
+#include <Client/RankCheck/ReplayManifest.hpp>
+#include <Client/RankCheck/ReplayParser.hpp>
 #include <Client/RankCheck/UsernameLookup.hpp>
 #include <SFML/Config.hpp>
 #include <SFML/Graphics/RenderStates.hpp>
@@ -19,6 +19,8 @@
 #include <thread>
 #include <condition_variable>
 #include <Shared/Utils/FileChooser.hpp>
+#include <Shared/Utils/SPSCQueue.hpp>
+#include <Shared/Utils/ThreadPool.hpp>
 #include <Shared/Utils/Timer.hpp>
 #include <atomic>
 #include <functional>
@@ -54,7 +56,11 @@ public:
 	RankCheckWidget();
 	virtual ~RankCheckWidget();
 
-	void requestPlayerDBRebuild();
+	/**
+	 * Asks whether to rebuild the player database. By default, only replays added or changed since the last build are
+	 * read. A rebuild from scratch clears the database first and reads all replays again.
+	 */
+	void requestPlayerDBRebuild(bool fromScratch = false);
 	float getPlayerDBBuildProgressVisibility() const;
 	std::string getPlayerDBBuildProgress() const;
 	void reshowPlayers();
@@ -74,22 +80,37 @@ private:
 	virtual void onRender(sf::RenderTarget & target, sf::RenderStates states) const override;
 
 	void initGuiCallbacks();
-	void initGameCallbacks();
 
 	void handleConfigChange();
 	void handleTick();
+	void handleLogEvent(const LogMonitor::Event & event);
 
 	gui3::Panel * getParentPanel() const;
 	void dumpSharedAccounts();
 	void dumpSponsoredAccounts();
 	std::string userToString(sf::Uint64 steamID) const;
 
-	void rebuildPlayerDB();
-	bool rebuildPlayerDBFromDirectory(std::string directory);
+	void rebuildPlayerDB(bool fromScratch = false);
+	bool rebuildPlayerDBFromDirectory(std::string directory, const ReplayManifest & previousManifest,
+		ReplayManifest & manifest);
+
+	/**
+	 * Merges the replays of matches finished since the last call into the database being rebuilt, and publishes the
+	 * database for the UI thread if enough time has passed. Only called by the rebuild threads, one at a time.
+	 */
+	void updatePlayerDBBuild();
 
 	void readStartupNetlog(PlayerDB & db);
 
-	void flushCurrentReplayDataToStats();
+	/**
+	 * Writes recent player database changes to its journal, and starts compacting the database in the background if
+	 * the journal has grown large enough.
+	 */
+	void flushPlayerDB();
+	void startPlayerDBCompaction();
+	void finishPlayerDBCompaction();
+
+	void addReplayDataToStats(const ReplayParser::ReplayInfo & info);
 
 	bool updatePlayerCard(PlayerData data);
 	void queueOrUpdatePlayerCard(PlayerData data);
@@ -97,6 +118,13 @@ private:
 	void queuePlayerCard(PlayerData main, PlayerData alt);
 	void updateAllPlayerCards();
 
+	/**
+	 * Starts the online lookups for a queued card, storing their results in the pending card. By the time the card is
+	 * shown, its lookups are answered from the caches or join the requests that are still running.
+	 */
+	void prefetchPlayerData(const PlayerData & data);
+	void updatePendingCards(sf::Uint64 steamID, std::function<void(PlayerData &)> update);
+
 	void updatePlayerDataFromLeaderboards(PlayerData & playerData, const RankChecker::Result & lbData);
 
 	std::shared_ptr<PlayerCard> createPlayerCard(PlayerData data, bool subCard);
@@ -106,6 +134,7 @@ private:
 	bool isSlotFree(int slot) const;
 
 	void lookupCountryForCard(std::shared_ptr<PlayerCard> card);
+	void setCountry(PlayerData & playerData, const std::string & countryCode);
 
 	void queueRatingDiff(int diff);
 	bool isRatingHistoryVisible() const;
@@ -115,18 +144,18 @@ private:
 	void updateScreenSize();
 
 	int messageBoxCount = 0;
+	HttpClient httpClient;
+
+	// Runs the online lookups; declared after httpClient, so the running lookups finish before it is destroyed.
+	ThreadPool lookupPool;
 	RankChecker checker;
 	sf::Clock timeSinceLastRequest;
 	sf::Clock timeSinceLastScreenResize;
-	ReplayWatcher replayWatcher;
-	NetworkLogReader netlogReader;
-	PersistentLogReader persistentReader;
-	GameLogReader gamelogReader;
+	LogMonitor logMonitor;
 	UsernameLookup usernameLookup;
 	CountryLookup countryLookup;
 	std::unique_ptr<sf::Font> cardFont;
 	std::vector<char> testFontData;
-	std::string currentReplayPath;
 	bool needToLoadDB = true;
 	bool needRankRequest = false;
 	bool needStartupNetlog = false;
@@ -145,6 +174,24 @@ private:
 	std::vector<std::string> playerDBReplayFolders;
 	Countdown playerDBBuildSuccessTimer;
 
+	// Shown while the success timer runs. Counting the players visits every changed entry, so it is done only once.
+	std::string playerDBBuildSummary;
+
+	// Replays of matches finished during a rebuild, passed from the UI thread to the rebuild thread.
+	SPSCQueue<ReplayParser::ReplayInfo> playerDBLiveReplays;
+
+	// Latest state of an incremental rebuild, published by the rebuild thread and taken over by the UI thread. Only
+	// accessed through std::atomic_load() and friends.
+	std::shared_ptr<const PlayerDB> playerDBBuildSnapshot;
+	bool playerDBBuildIncremental = false;
+	sf::Clock playerDBBuildSnapshotClock;
+
+	std::unique_ptr<PlayerDB::Compaction> playerDBCompaction;
+	std::atomic_bool playerDBCompactionDone;
+	std::thread playerDBCompactionThread;
+	bool playerDBCompactionOutdated = false;
+	bool playerDBSaveRequested = false;
+
 	FileChooser gameDirChooser;
 
 	struct PendingCard
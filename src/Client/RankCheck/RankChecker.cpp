@@ -1,28 +1,239 @@
 #include <Client/RankCheck/LeagueReader.hpp>
 #include <Client/RankCheck/RankChecker.hpp>
-#include <SFML/Network/Http.hpp>
-#include <Shared/Config/DataTypes.hpp>
-#include <Shared/Config/JSONConfig.hpp>
+#include <Poco/Timestamp.h>
 #include <Shared/Utils/DebugLog.hpp>
-#include <Shared/Utils/MakeUnique.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
+#include <Shared/Utils/Utilities.hpp>
+#include <rapidjson/error/en.h>
+#include <rapidjson/reader.h>
 #include <algorithm>
 #include <cstddef>
-#include <exception>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
 #include <utility>
 
-RankChecker::RankChecker()
+static const std::size_t scoreCount = 14;
+static const std::size_t maxCachedResults = 4096;
+
+// Results are kept at least this many seconds, even if the next leaderboard update is overdue.
+static const sf::Int64 minimumCacheTime = 60;
+
+/**
+ * Fills a ParseResult while the response is being parsed, without building a document first.
+ */
+class RankChecker::ParseHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ParseHandler>
+{
+public:
+
+	explicit ParseHandler(ParseResult & result) :
+		result(result)
+	{
+	}
+
+	bool Default()
+	{
+		field = None;
+		return true;
+	}
+
+	bool Int(int i)
+	{
+		return setValue(i);
+	}
+
+	bool Uint(unsigned u)
+	{
+		return setValue(u);
+	}
+
+	bool Int64(int64_t i)
+	{
+		return setValue(i);
+	}
+
+	bool Uint64(uint64_t u)
+	{
+		return setValue(u);
+	}
+
+	bool Double(double d)
+	{
+		return setValue(sf::Int64(d));
+	}
+
+	bool String(const char * str, rapidjson::SizeType length, bool copy)
+	{
+		// Numbers may be sent as strings. The parser terminates all strings it passes on.
+		return setValue(std::strtoull(str, nullptr, 10));
+	}
+
+	bool Key(const char * str, rapidjson::SizeType length, bool copy)
+	{
+		static const struct
+		{
+			const char * key;
+			std::size_t index;
+		} scoreFields[] = {
+			{"rank", 0},
+			{"rating", 1},
+			{"totalWins", 3},
+			{"totalLosses", 4},
+			{"mainNaut", 8},
+			{"seasonWins", 9},
+			{"seasonLosses", 10}
+		};
+
+		field = None;
+		if (depth == 1)
+		{
+			if (isKey(str, length, "totalEntryCount"))
+			{
+				field = EntryCount;
+			}
+			else if (isKey(str, length, "lastUpdate"))
+			{
+				field = LastUpdate;
+			}
+			else if (isKey(str, length, "entries"))
+			{
+				field = Entries;
+			}
+		}
+		else if (depth == 3 && inEntries)
+		{
+			if (isKey(str, length, "steamid"))
+			{
+				field = SteamID;
+			}
+			for (const auto & scoreField : scoreFields)
+			{
+				if (isKey(str, length, scoreField.key))
+				{
+					field = Score;
+					scoreIndex = scoreField.index;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool StartObject()
+	{
+		++depth;
+		if (depth == 3 && inEntries)
+		{
+			// Fields missing from an entry are read as 0.
+			entry.code = Result::Success;
+			entry.steamID = 0;
+			entry.scoredata.assign(scoreCount, -1);
+			for (std::size_t index : {0, 1, 3, 4, 8, 9, 10})
+			{
+				entry.scoredata[index] = 0;
+			}
+		}
+		field = None;
+		return true;
+	}
+
+	bool EndObject(rapidjson::SizeType memberCount)
+	{
+		if (depth == 3 && inEntries)
+		{
+			result.entries.emplace(entry.steamID, entry);
+		}
+		--depth;
+		field = None;
+		return true;
+	}
+
+	bool StartArray()
+	{
+		++depth;
+		if (depth == 2 && field == Entries)
+		{
+			inEntries = true;
+		}
+		field = None;
+		return true;
+	}
+
+	bool EndArray(rapidjson::SizeType elementCount)
+	{
+		if (depth == 2)
+		{
+			inEntries = false;
+		}
+		--depth;
+		field = None;
+		return true;
+	}
+
+private:
+
+	enum Field
+	{
+		None,
+		EntryCount,
+		LastUpdate,
+		Entries,
+		SteamID,
+		Score
+	};
+
+	static bool isKey(const char * str, rapidjson::SizeType length, const char * key)
+	{
+		return std::strlen(key) == length && std::memcmp(str, key, length) == 0;
+	}
+
+	template <typename T>
+	bool setValue(T value)
+	{
+		switch (field)
+		{
+		case EntryCount:
+			result.info.entryCount = value;
+			break;
+		case LastUpdate:
+			result.info.lastUpdateTime = value;
+			break;
+		case SteamID:
+			entry.steamID = value;
+			break;
+		case Score:
+			entry.scoredata[scoreIndex] = value;
+			break;
+		default:
+			break;
+		}
+		field = None;
+		return true;
+	}
+
+	ParseResult & result;
+	Result entry;
+	Field field = None;
+	std::size_t scoreIndex = 0;
+
+	// The response object is at depth 1, the entry list at depth 2 and each entry at depth 3.
+	int depth = 0;
+	bool inEntries = false;
+};
+
+RankChecker::RankChecker(HttpClient & client, ThreadPool & pool) :
+	client(client),
+	pool(pool),
+	cancelFlag(std::make_shared<std::atomic_bool>(false)),
+	cache("leaderboard.cache", maxCachedResults, 0),
+	updateInterval(30 * 60),
+	lastUpdateTime(0)
 {
 	localSteamID = 0;
 }
 
 RankChecker::~RankChecker()
 {
-	for (const auto & conn : connections)
-	{
-		conn->thread.join();
-	}
+	cancel();
 }
 
 void RankChecker::setLocalSteamID(sf::Uint64 localSteamID)
@@ -30,6 +241,17 @@ void RankChecker::setLocalSteamID(sf::Uint64 localSteamID)
 	this->localSteamID = localSteamID;
 }
 
+void RankChecker::setCacheParameters(sf::Int64 updateInterval, bool persistent)
+{
+	this->updateInterval = updateInterval;
+	cache.setPersistent(persistent);
+}
+
+void RankChecker::saveCache()
+{
+	cache.save();
+}
+
 void RankChecker::setHost(std::string host, unsigned short port)
 {
 	this->host = host;
@@ -45,6 +267,20 @@ void RankChecker::setUriParameters(std::string prefix, std::string separator, st
 
 void RankChecker::addSteamIDRequest(sf::Uint64 steamID, std::function<void(Result)> callback)
 {
+	Result result;
+	if (getCachedResult(steamID, result))
+	{
+		callback(result);
+		return;
+	}
+
+	auto inFlight = inFlightRequests.find(steamID);
+	if (inFlight != inFlightRequests.end())
+	{
+		(*inFlight->second)[steamID].push_back(callback);
+		return;
+	}
+
 	pendingRequests.push_back({steamID, callback});
 }
 
@@ -58,143 +294,172 @@ void RankChecker::sendRequestIfNeeded()
 
 void RankChecker::sendRequest(InfoCallback callback)
 {
-	std::unique_ptr<Connection> conn = makeUnique<Connection>();
+	auto callbacks = std::make_shared<CallbackMap>();
 	for (auto & req : pendingRequests)
 	{
-		conn->callbacks[req.steamID].push_back(std::move(req.callback));
+		(*callbacks)[req.steamID].push_back(std::move(req.callback));
 	}
 	pendingRequests.clear();
 
-	Connection * connPtr = conn.get();
-	conn->thread = std::thread([this,connPtr]()
+	std::string queryString;
+	bool firstQueryStringPart = true;
+	for (const auto & queryStringPart : *callbacks)
 	{
-		sf::Http http;
-		http.setHost(host, port);
+		inFlightRequests[queryStringPart.first] = callbacks;
 
-		std::string queryString;
-		bool firstQueryStringPart = true;
-		for (const auto & queryStringPart : connPtr->callbacks)
+		if (firstQueryStringPart)
 		{
-			if (firstQueryStringPart)
-			{
-				firstQueryStringPart = false;
-			}
-			else
-			{
-				queryString += uriSeparator;
-			}
-			queryString += cNtoS(queryStringPart.first);
+			firstQueryStringPart = false;
 		}
+		else
+		{
+			queryString += uriSeparator;
+		}
+		queryString += cNtoS(queryStringPart.first);
+	}
 
-		sf::Http::Request request;
-		request.setUri(uriPrefix + queryString + uriSuffix);
+	HttpClient & client = this->client;
+	std::string host = this->host;
+	unsigned short port = this->port;
+	std::string uri = uriPrefix + queryString + uriSuffix;
+	HttpClient::CancelFlag cancelled = cancelFlag;
+	auto response = std::make_shared<HttpClient::Response>();
 
-		sf::Http::Response response = http.sendRequest(request);
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<ThreadPool::Job> & job)
+	{
+		return job->isFinished();
+	}), jobs.end());
 
-		connPtr->result = response.getBody();
-		connPtr->done = true;
-	});
+	jobs.push_back(pool.submit([&client,host,port,uri,cancelled,response]()
+	{
+		*response = client.get(host, port, uri, cancelled);
+	},
+	[this,callbacks,response]()
+	{
+		handleResponse(*response, *callbacks);
+	}));
+}
 
-	connections.push_back(std::move(conn));
+void RankChecker::cancel()
+{
+	pendingRequests.clear();
+	inFlightRequests.clear();
+	*cancelFlag = true;
+	cancelFlag = std::make_shared<std::atomic_bool>(false);
+	for (const auto & job : jobs)
+	{
+		job->cancel();
+	}
+	jobs.clear();
 }
 
-void RankChecker::process()
+void RankChecker::handleResponse(const HttpClient::Response & response, const CallbackMap & callbacks)
 {
-	for (auto it = connections.begin(); it != connections.end();)
+	ParseResult result = (response.status != 0) ? parseJSON(response.body) : ParseResult();
+
+	// Results stay valid until the server is expected to update the leaderboard again. Failed requests are not cached.
+	sf::Int64 timeToLive = 0;
+	if (result.success && result.info.lastUpdateTime != 0)
 	{
-		Connection & connection = **it;
-		if (connection.done)
+		lastUpdateTime = std::max(lastUpdateTime, result.info.lastUpdateTime);
+		sf::Int64 nextUpdateTime = sf::Int64(result.info.lastUpdateTime) + updateInterval;
+		timeToLive = std::min(std::max(nextUpdateTime - Poco::Timestamp().epochTime(), minimumCacheTime),
+			updateInterval);
+	}
+
+	for (const auto & callback : callbacks)
+	{
+		auto inFlight = inFlightRequests.find(callback.first);
+		if (inFlight != inFlightRequests.end() && inFlight->second.get() == &callbacks)
+		{
+			inFlightRequests.erase(inFlight);
+		}
+
+		Result res;
+		res.steamID = callback.first;
+		if (!result.success)
 		{
-			ParseResult result = parseJSON(connection.result);
-			for (const auto & callback : connection.callbacks)
+			res.code = response.timedOut ? Result::Timeout : Result::NotFound;
+		}
+		else
+		{
+			auto it = result.entries.find(callback.first);
+			if (it == result.entries.end())
 			{
-				Result res;
-				if (!result.success)
-				{
-					res.code = Result::NotFound;
-				}
-				else
-				{
-					auto it2 = result.entries.find(callback.first);
-					if (it2 == result.entries.end())
-					{
-						res.code = Result::NotFound;
-					}
-					else
-					{
-						res = it2->second;
-						res.code = Result::Success;
-					}
-				}
-				for (const auto & cb : callback.second)
-				{
-					cb(res);
-				}
+				res.code = Result::NotFound;
+			}
+			else
+			{
+				res = it->second;
+				res.code = Result::Success;
 			}
-			connection.thread.detach();
-			it = connections.erase(it);
 		}
-		else
+
+		if (timeToLive > 0)
 		{
-			++it;
+			setCachedResult(res, result.info.lastUpdateTime, timeToLive);
+		}
+
+		for (const auto & cb : callback.second)
+		{
+			cb(res);
 		}
 	}
 }
 
 RankChecker::ParseResult RankChecker::parseJSON(const std::string& json)
 {
-	cfg::JSONConfig config;
-	try
-	{
-		config.loadFromString(json);
-	}
-	catch (std::exception & e)
+	ParseResult result;
+	ParseHandler handler(result);
+	rapidjson::Reader reader;
+	rapidjson::StringStream stream(json.c_str());
+
+	if (reader.Parse<rapidjson::kParseTrailingCommasFlag | rapidjson::kParseCommentsFlag>(stream, handler).IsError())
 	{
-		debug() << e.what();
+		debug() << "Error parsing JSON: " << rapidjson::GetParseError_En(reader.GetParseErrorCode()) << " (at "
+			<< reader.GetErrorOffset() << ")";
 		return ParseResult();
 	}
 
-	auto getInt = [&config](const std::string & key)
-	{
-		return cStoI(config.readValue(key).content);
-	};
-	auto getULong = [&config](const std::string & key)
-	{
-		return cStoUL(config.readValue(key).content);
-	};
-
-	ParseResult result;
-
 	result.success = true;
-	result.info.entryCount = getULong("totalEntryCount");
-	result.info.lastUpdateTime = getULong("lastUpdate");
 
 	LeagueReader::getInstance().setEntryCount(result.info.entryCount);
 
-	for (std::size_t i = 0; i < getULong("entries.length"); ++i)
+	return result;
+}
+
+bool RankChecker::getCachedResult(sf::Uint64 steamID, Result & result)
+{
+	std::string value;
+	if (!cache.get(cNtoS(steamID), value))
 	{
-		auto getEntryInt = [&](const std::string & key)
-		{
-			return getInt("entries[" + cNtoS(i) + "]." + key);
-		};
-		auto getEntryULong = [&](const std::string & key)
-		{
-			return getULong("entries[" + cNtoS(i) + "]." + key);
-		};
+		return false;
+	}
 
-		Result entry;
-		entry.code = Result::Success;
-		entry.scoredata = std::vector<sf::Int32>(14, -1);
-		entry.steamID = getEntryULong("steamid");
-		entry.scoredata[0] = getEntryInt("rank");
-		entry.scoredata[1] = getEntryInt("rating");
-		entry.scoredata[3] = getEntryInt("totalWins");
-		entry.scoredata[4] = getEntryInt("totalLosses");
-		entry.scoredata[8] = getEntryInt("mainNaut");
-		entry.scoredata[9] = getEntryInt("seasonWins");
-		entry.scoredata[10] = getEntryInt("seasonLosses");
-		result.entries.emplace(entry.steamID, std::move(entry));
+	// Stored as the leaderboard's update time, the result code and the score data, separated by commas.
+	std::vector<std::string> fields;
+	splitString(value, ",", fields);
+	if (fields.size() != scoreCount + 2 || cStoUL(fields[0]) < lastUpdateTime)
+	{
+		return false;
 	}
 
-	return result;
+	result.steamID = steamID;
+	result.code = Result::Code(cStoI(fields[1]));
+	result.scoredata.resize(scoreCount);
+	for (std::size_t i = 0; i < scoreCount; ++i)
+	{
+		result.scoredata[i] = cStoI(fields[i + 2]);
+	}
+	return true;
+}
+
+void RankChecker::setCachedResult(const Result & result, sf::Uint64 updateTime, sf::Int64 timeToLive)
+{
+	std::string value = cNtoS(updateTime) + "," + cNtoS(int(result.code));
+	for (std::size_t i = 0; i < scoreCount; ++i)
+	{
+		value += "," + cNtoS(i < result.scoredata.size() ? result.scoredata[i] : -1);
+	}
+	cache.set(cNtoS(result.steamID), value, timeToLive);
 }
@@ -1,18 +1,24 @@
 #ifndef SRC_CLIENT_RANKCHECK_RANKCHECKER_HPP_
 #define SRC_CLIENT_RANKCHECK_RANKCHECKER_HPP_
 
+#include <Client/RankCheck/HttpClient.hpp>
+#include <Client/RankCheck/LookupCache.hpp>
 #include <SFML/Config.hpp>
+#include <Shared/Utils/ThreadPool.hpp>
 #include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
-#include <thread>
 #include <vector>
-#include <mutex>
-#include <thread>
-#include <condition_variable>
 
+/**
+ * Looks up the leaderboard entries of players, sending the SteamIDs requested during a tick in one request.
+ *
+ * The leaderboard only changes when the server updates it, so results are cached until the next expected update, and
+ * optionally kept on disk. A SteamID that is requested again while its lookup is still in progress waits for that
+ * lookup instead of starting another.
+ */
 class RankChecker
 {
 public:
@@ -37,37 +43,71 @@ public:
 
 	struct InfoResult
 	{
-		sf::Uint64 entryCount;
-		sf::Uint64 lastUpdateTime;
+		sf::Uint64 entryCount = 0;
+		sf::Uint64 lastUpdateTime = 0;
+	};
+
+	struct ParseResult
+	{
+		bool success = false;
+		InfoResult info;
+		std::map<sf::Uint64, Result> entries;
 	};
 
 	using EntryCallback = std::function<void(Result)>;
 	using InfoCallback = std::function<void(InfoResult)>;
 
-	RankChecker();
+	/**
+	 * Requests are sent on the pool's threads, and the callbacks are run by ThreadPool::processCallbacks().
+	 */
+	RankChecker(HttpClient & client, ThreadPool & pool);
 	virtual ~RankChecker();
 
 	void setHost(std::string host, unsigned short port);
 	void setUriParameters(std::string prefix, std::string separator, std::string suffix);
 	void setLocalSteamID(sf::Uint64 localSteamID);
 
+	/**
+	 * Sets the number of seconds between two leaderboard updates on the server, and whether cached results are stored
+	 * on disk.
+	 */
+	void setCacheParameters(sf::Int64 updateInterval, bool persistent);
+
+	/**
+	 * Writes the cached results to disk if persistent caching is enabled.
+	 */
+	void saveCache();
+
+	/**
+	 * Queues a lookup for the next request. Calls the callback immediately if the result is cached.
+	 */
 	void addSteamIDRequest(sf::Uint64 steamID, EntryCallback callback);
 	void sendRequestIfNeeded();
 	void sendRequest(InfoCallback callback);
 
-	void process();
+	/**
+	 * Drops all pending and unsent requests without calling their callbacks.
+	 */
+	void cancel();
+
+	/**
+	 * Reads the entries of a leaderboard response. Public so that the parser can be benchmarked on its own.
+	 */
+	static ParseResult parseJSON(const std::string & json);
 
 private:
 
-	struct ParseResult
-	{
-		bool success = false;
-		InfoResult info;
-		std::map<sf::Uint64, Result> entries;
-	};
+	using CallbackMap = std::map<sf::Uint64, std::vector<EntryCallback> >;
 
-	static ParseResult parseJSON(const std::string & json);
+	class ParseHandler;
+
+	void handleResponse(const HttpClient::Response & response, const CallbackMap & callbacks);
+
+	bool getCachedResult(sf::Uint64 steamID, Result & result);
+	void setCachedResult(const Result & result, sf::Uint64 updateTime, sf::Int64 timeToLive);
 
+	HttpClient & client;
+	ThreadPool & pool;
 	sf::Uint64 localSteamID;
 	std::string host;
 	std::string uriPrefix;
@@ -81,16 +121,19 @@ private:
 		EntryCallback callback;
 	};
 
-	struct Connection
-	{
-		std::atomic_bool done = ATOMIC_VAR_INIT(false);
-		std::thread thread;
-		std::string result;
-		std::map<sf::Uint64, std::vector<EntryCallback> > callbacks;
-	};
-
 	std::vector<PendingRequest> pendingRequests;
-	std::vector<std::unique_ptr<Connection> > connections;
+	std::vector<std::shared_ptr<ThreadPool::Job> > jobs;
+	// Shared with the requests sent so far, which are abandoned once it is set. Replaced by cancel().
+	std::shared_ptr<std::atomic_bool> cancelFlag;
+
+	// Callbacks of the requests that have been sent but not answered yet, by SteamID.
+	std::map<sf::Uint64, std::shared_ptr<CallbackMap> > inFlightRequests;
+
+	LookupCache cache;
+	sf::Int64 updateInterval;
+
+	// Most recent leaderboard update seen in a response. Results cached before it are outdated.
+	sf::Uint64 lastUpdateTime;
 };
 
 #endif
@@ -0,0 +1,111 @@
+#include <Client/RankCheck/ReplayManifest.hpp>
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Shared/Utils/DataStream.hpp>
+#include <Shared/Utils/DebugLog.hpp>
+#include <exception>
+
+static constexpr sf::Int32 HEADER = 1333339;
+static constexpr sf::Int16 VERSION = 0;
+
+ReplayManifest::ReplayManifest()
+{
+	Poco::Path dir(Poco::Path::dataHome());
+	dir.pushDirectory("rankcheck");
+	MANIFEST_FILENAME = Poco::Path(dir, "replays.manifest").toString();
+}
+
+ReplayManifest::~ReplayManifest()
+{
+}
+
+bool ReplayManifest::load()
+{
+	clear();
+
+	DataStream stream;
+	if (!stream.openInFile(MANIFEST_FILENAME))
+	{
+		return false;
+	}
+
+	sf::Int32 header;
+	sf::Int16 version;
+	stream >> header >> version;
+
+	if (!stream.isValid() || header != HEADER || version != VERSION)
+	{
+		debug() << "Ignoring unrecognized replay manifest " << MANIFEST_FILENAME;
+		return false;
+	}
+
+	stream >> entries;
+
+	if (!stream.isValid())
+	{
+		debug() << "Ignoring corrupt replay manifest " << MANIFEST_FILENAME;
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool ReplayManifest::save() const
+{
+	DataStream stream;
+	if (!stream.openOutFile(MANIFEST_FILENAME))
+	{
+		debug() << "Failed to write replay manifest " << MANIFEST_FILENAME;
+		return false;
+	}
+
+	stream << HEADER << VERSION << entries;
+	return true;
+}
+
+void ReplayManifest::clear()
+{
+	entries.clear();
+}
+
+bool ReplayManifest::readFileInfo(const std::string & replayFile, Entry & entry)
+{
+	try
+	{
+		Poco::File file(replayFile);
+		entry.modificationTime = file.getLastModified().epochMicroseconds();
+		entry.size = file.getSize();
+		return true;
+	}
+	catch (std::exception & ex)
+	{
+		return false;
+	}
+}
+
+bool ReplayManifest::Entry::hasSameFileInfo(const Entry & other) const
+{
+	return modificationTime == other.modificationTime && size == other.size;
+}
+
+const ReplayManifest::Entry * ReplayManifest::getEntry(const std::string & replayDir) const
+{
+	auto it = entries.find(replayDir);
+	return it == entries.end() ? nullptr : &it->second;
+}
+
+void ReplayManifest::setEntry(const std::string & replayDir, const Entry & entry)
+{
+	entries[replayDir] = entry;
+}
+
+DataStream & operator<<(DataStream & stream, const ReplayManifest::Entry & entry)
+{
+	return stream << entry.modificationTime << entry.size << entry.countStats << entry.hash;
+}
+
+DataStream & operator>>(DataStream & stream, ReplayManifest::Entry & entry)
+{
+	return stream >> entry.modificationTime >> entry.size >> entry.countStats >> entry.hash;
+}
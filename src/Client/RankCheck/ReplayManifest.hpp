@@ -0,0 +1,64 @@
+#ifndef SRC_CLIENT_RANKCHECK_REPLAYMANIFEST_HPP_
+#define SRC_CLIENT_RANKCHECK_REPLAYMANIFEST_HPP_
+
+#include <Client/RankCheck/ReplayParser.hpp>
+#include <SFML/Config.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+
+class DataStream;
+
+/**
+ * List of replay directories read while building the player database, stored alongside the database.
+ *
+ * Each replay directory is recorded with the modification time and size of its replay file, as well as the replay's
+ * hash. A directory whose replay file is unchanged does not need to be parsed again, as long as its replay is still
+ * part of the database.
+ */
+class ReplayManifest
+{
+public:
+
+	struct Entry
+	{
+		sf::Int64 modificationTime = 0;
+		sf::Uint64 size = 0;
+		bool countStats = false;
+		ReplayParser::ReplayInfo::Hash hash = ReplayParser::ReplayInfo::Hash();
+
+		/**
+		 * Returns true if both entries have the same file modification time and size.
+		 */
+		bool hasSameFileInfo(const Entry & other) const;
+	};
+
+	ReplayManifest();
+	~ReplayManifest();
+
+	bool load();
+	bool save() const;
+
+	void clear();
+
+	/**
+	 * Fills in the modification time and size of a replay file. Returns false if the file cannot be accessed.
+	 */
+	static bool readFileInfo(const std::string & replayFile, Entry & entry);
+
+	/**
+	 * Returns the recorded entry for a replay directory, or nullptr if there is none.
+	 */
+	const Entry * getEntry(const std::string & replayDir) const;
+	void setEntry(const std::string & replayDir, const Entry & entry);
+
+private:
+
+	std::string MANIFEST_FILENAME;
+	std::map<std::string, Entry> entries;
+};
+
+DataStream & operator<<(DataStream & stream, const ReplayManifest::Entry & entry);
+DataStream & operator>>(DataStream & stream, ReplayManifest::Entry & entry);
+
+#endif
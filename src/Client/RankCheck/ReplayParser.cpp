@@ -3,9 +3,12 @@
 #include <pugixml.hpp>
 #include <Shared/Utils/DataStream.hpp>
 #include <Shared/Utils/DebugLog.hpp>
+#include <Shared/Utils/Filesystem/MappedFile.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
+#include <Shared/Utils/StringView.hpp>
 #include <map>
 #include <utility>
+#include <vector>
 
 ReplayParser::ReplayParser(std::string replayFile) :
 	replayFile(replayFile)
@@ -32,92 +35,624 @@ static const std::pair<std::string, sf::Uint64> parseSteamID(const std::string &
 	}
 }
 
-ReplayParser::ReplayInfo ReplayParser::parse()
+namespace
 {
-	std::map<sf::Uint64, std::size_t> playerMap;
-	ReplayInfo info;
 
-	pugi::xml_document doc;
-	pugi::xml_parse_result result = doc.load_file(replayFile.c_str());
+/**
+ * Forward-only reader for the tags of an XML document.
+ *
+ * Supports elements with quoted attributes, text, comments and processing instructions, which covers everything found
+ * in replay files. Anything else (such as DOCTYPE declarations or CDATA sections) is reported as an error, as are null
+ * characters, which pugixml treats differently. Only the part of the text up to the current tag is ever looked at.
+ */
+class XmlTagReader
+{
+public:
 
-	if (!result)
+	enum TagType
+	{
+		StartTag,
+		EmptyTag,
+		EndTag,
+		EndOfInput,
+		Error
+	};
+
+	XmlTagReader(StringView text) :
+		text(text),
+		pos(0)
 	{
-		debug() << "Failed to parse " << replayFile << ": " << result.description();
-		return info;
 	}
 
-	pugi::xml_node replay = doc.root().child("Replay");
+	TagType next()
+	{
+		while (true)
+		{
+			std::size_t tagStart = text.find('<', pos);
+			if (text.substr(pos, tagStart - pos).find('\0') != StringView::npos)
+			{
+				return Error;
+			}
+			if (tagStart == StringView::npos)
+			{
+				return EndOfInput;
+			}
+			pos = tagStart + 1;
 
-	if (replay.attribute("onlineMatch").as_uint(1))
+			StringView rest = text.substr(pos);
+			if (rest.startsWith("!--"))
+			{
+				if (!skipPast("-->"))
+				{
+					return Error;
+				}
+			}
+			else if (rest.startsWith("?"))
+			{
+				if (!skipPast("?>"))
+				{
+					return Error;
+				}
+			}
+			else if (rest.startsWith("!"))
+			{
+				return Error;
+			}
+			else if (rest.startsWith("/"))
+			{
+				++pos;
+				name = readName();
+				skipWhitespace();
+				if (name.empty() || pos >= text.size() || text[pos] != '>')
+				{
+					return Error;
+				}
+				++pos;
+				return EndTag;
+			}
+			else
+			{
+				return readStartTag();
+			}
+		}
+	}
+
+	StringView getName() const
 	{
-		info.countStats = true;
+		return name;
 	}
 
-	info.hash = ReplayInfo::Hash(replay.child("Hash").attribute("hash").as_string(""));
+	/**
+	 * Returns the undecoded value of the tag's first attribute with the specified name.
+	 */
+	bool getAttribute(StringView attributeName, StringView & value) const
+	{
+		for (const auto & attribute : attributes)
+		{
+			if (attribute.first == attributeName)
+			{
+				value = attribute.second;
+				return true;
+			}
+		}
+		return false;
+	}
 
-	pugi::xml_node characters = replay.child("Characters");
+private:
 
-	for (const auto & character : characters)
+	static bool isWhitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	static bool isNameEnd(char c)
+	{
+		return isWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '\0';
+	}
+
+	void skipWhitespace()
 	{
-		if (character.attribute("isBot").as_uint(1) == 1)
+		while (pos < text.size() && isWhitespace(text[pos]))
 		{
-			continue;
+			++pos;
 		}
+	}
 
-		PlayerData player;
+	bool skipPast(StringView terminator)
+	{
+		std::size_t end = text.find(terminator, pos);
+		if (end == StringView::npos || text.substr(pos, end - pos).find('\0') != StringView::npos)
+		{
+			return false;
+		}
+		pos = end + terminator.size();
+		return true;
+	}
 
-		auto steamID = parseSteamID(character.attribute("steamId").as_string("#0"));
-		auto sponsorID = parseSteamID(
-			character.attribute("sponsorSteamId").as_string(character.attribute("steamId").as_string("#0")));
+	StringView readName()
+	{
+		std::size_t start = pos;
+		while (pos < text.size() && !isNameEnd(text[pos]))
+		{
+			++pos;
+		}
+		return text.substr(start, pos - start);
+	}
 
-		player.steamID = steamID.second;
-		player.currentName = steamID.first;
-		//player.currentName = character.attribute("name").as_string();
-		player.team = character.attribute("team").as_uint(0) == 0 ? PlayerData::Red : PlayerData::Blue;
-		player.currentNaut = NautsNames::getInstance().resolveClassName(character.attribute("className").as_string());
-		player.currentSkin = character.attribute("skin").as_int(0);
-		player.isLocal = character.attribute("local").as_uint(0);
+	TagType readStartTag()
+	{
+		attributes.clear();
+		name = readName();
+		if (name.empty())
+		{
+			return Error;
+		}
 
-		if (player.isLocal)
+		while (true)
 		{
-			info.localTeam = player.team;
+			skipWhitespace();
+			if (pos >= text.size())
+			{
+				return Error;
+			}
+			else if (text[pos] == '>')
+			{
+				++pos;
+				return StartTag;
+			}
+			else if (text.substr(pos).startsWith("/>"))
+			{
+				pos += 2;
+				return EmptyTag;
+			}
+
+			StringView attributeName = readName();
+			skipWhitespace();
+			if (attributeName.empty() || pos >= text.size() || text[pos] != '=')
+			{
+				return Error;
+			}
+			++pos;
+			skipWhitespace();
+			if (pos >= text.size() || (text[pos] != '"' && text[pos] != '\''))
+			{
+				return Error;
+			}
+
+			std::size_t valueEnd = text.find(text[pos], pos + 1);
+			if (valueEnd == StringView::npos)
+			{
+				return Error;
+			}
+			StringView value = text.substr(pos + 1, valueEnd - pos - 1);
+			if (value.find('<') != StringView::npos || value.find('\0') != StringView::npos)
+			{
+				return Error;
+			}
+			attributes.emplace_back(attributeName, value);
+			pos = valueEnd + 1;
 		}
+	}
 
-		PlayerData sponsor;
+	StringView text;
+	std::size_t pos;
+	StringView name;
+	std::vector<std::pair<StringView, StringView> > attributes;
+};
 
-		if (sponsorID != steamID && sponsorID.second != 0)
+static void appendUTF8(std::string & str, sf::Uint32 codepoint)
+{
+	if (codepoint < 0x80)
+	{
+		str += char(codepoint);
+	}
+	else if (codepoint < 0x800)
+	{
+		str += char(0xC0 | (codepoint >> 6));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+	else if (codepoint < 0x10000)
+	{
+		str += char(0xE0 | (codepoint >> 12));
+		str += char(0x80 | ((codepoint >> 6) & 0x3F));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+	else
+	{
+		str += char(0xF0 | (codepoint >> 18));
+		str += char(0x80 | ((codepoint >> 12) & 0x3F));
+		str += char(0x80 | ((codepoint >> 6) & 0x3F));
+		str += char(0x80 | (codepoint & 0x3F));
+	}
+}
+
+/**
+ * Decodes an attribute value the same way pugixml does by default: entity and character references are expanded, and
+ * line breaks and tabs are converted to spaces.
+ */
+static std::string decodeAttribute(StringView value)
+{
+	std::string decoded;
+	decoded.reserve(value.size());
+
+	for (std::size_t i = 0; i < value.size(); ++i)
+	{
+		char c = value[i];
+		if (c == '\r')
 		{
-			sponsor = player;
-			sponsor.type = PlayerData::Sponsor;
-			sponsor.currentName = sponsorID.first;
-			sponsor.steamID = sponsorID.second;
-			sponsor.currentNaut = 0;
-			sponsor.currentSkin = 0;
-			sponsor.isLocal = false;
+			decoded += ' ';
+			if (i + 1 < value.size() && value[i + 1] == '\n')
+			{
+				++i;
+			}
+		}
+		else if (c == '\n' || c == '\t')
+		{
+			decoded += ' ';
+		}
+		else if (c == '&')
+		{
+			StringView rest = value.substr(i + 1);
+			std::size_t end = rest.find(';');
+			StringView entity = rest.substr(0, end);
+			bool known = true;
+
+			if (end == StringView::npos)
+			{
+				known = false;
+			}
+			else if (entity == "lt")
+			{
+				decoded += '<';
+			}
+			else if (entity == "gt")
+			{
+				decoded += '>';
+			}
+			else if (entity == "amp")
+			{
+				decoded += '&';
+			}
+			else if (entity == "apos")
+			{
+				decoded += '\'';
+			}
+			else if (entity == "quot")
+			{
+				decoded += '"';
+			}
+			else if (entity.startsWith("#") && entity.size() > 1)
+			{
+				bool hex = entity[1] == 'x';
+				StringView digits = entity.substr(hex ? 2 : 1);
+				sf::Uint32 codepoint = 0;
+				known = !digits.empty();
+				for (char digit : digits)
+				{
+					if (digit >= '0' && digit <= '9')
+					{
+						codepoint = codepoint * (hex ? 16 : 10) + (digit - '0');
+					}
+					else if (hex && ((digit >= 'a' && digit <= 'f') || (digit >= 'A' && digit <= 'F')))
+					{
+						codepoint = codepoint * 16 + ((digit | 0x20) - 'a' + 10);
+					}
+					else
+					{
+						known = false;
+						break;
+					}
+				}
+				if (known)
+				{
+					appendUTF8(decoded, codepoint);
+				}
+			}
+			else
+			{
+				known = false;
+			}
 
-			player.type = PlayerData::SponsoredPlayer;
+			if (known)
+			{
+				i += end + 1;
+			}
+			else
+			{
+				decoded += '&';
+			}
 		}
 		else
 		{
-			player.type = PlayerData::Player;
+			decoded += c;
 		}
+	}
+
+	return decoded;
+}
 
-		PlayerInfo playerInfo { player, sponsor };
+/**
+ * Parses an integer attribute value the same way as pugixml's as_int()/as_uint().
+ */
+static long long parseInteger(StringView value)
+{
+	std::size_t i = 0;
+	while (i < value.size() && (value[i] == ' ' || value[i] == '\t' || value[i] == '\n' || value[i] == '\r'))
+	{
+		++i;
+	}
+
+	bool negative = i < value.size() && value[i] == '-';
+	if (negative)
+	{
+		++i;
+	}
 
-		if (playerMap.count(steamID.second))
+	long long result = 0;
+	if (i + 1 < value.size() && value[i] == '0' && (value[i + 1] == 'x' || value[i + 1] == 'X'))
+	{
+		for (i += 2; i < value.size(); ++i)
 		{
-			info.players[playerMap[steamID.second]] = playerInfo;
+			char digit = value[i] | 0x20;
+			if (value[i] >= '0' && value[i] <= '9')
+			{
+				result = result * 16 + (value[i] - '0');
+			}
+			else if (digit >= 'a' && digit <= 'f')
+			{
+				result = result * 16 + (digit - 'a' + 10);
+			}
+			else
+			{
+				break;
+			}
 		}
-		else
+	}
+	else
+	{
+		for (; i < value.size() && value[i] >= '0' && value[i] <= '9'; ++i)
 		{
-			playerMap[steamID.second] = info.players.size();
-			info.players.push_back(playerInfo);
+			result = result * 10 + (value[i] - '0');
 		}
 	}
 
+	return negative ? -result : result;
+}
+
+static long long getIntegerAttribute(const XmlTagReader & reader, StringView name, long long defaultValue)
+{
+	StringView value;
+	return reader.getAttribute(name, value) ? parseInteger(decodeAttribute(value)) : defaultValue;
+}
+
+static std::string getStringAttribute(const XmlTagReader & reader, StringView name, const std::string & defaultValue)
+{
+	StringView value;
+	return reader.getAttribute(name, value) ? decodeAttribute(value) : defaultValue;
+}
+
+}
+
+ReplayParser::ReplayInfo ReplayParser::parse()
+{
+	ReplayInfo info;
+
+	if (!parseStreaming(info))
+	{
+		info = ReplayInfo();
+		parseDocument(info);
+	}
+
 	return info;
 }
 
+bool ReplayParser::parseStreaming(ReplayInfo & info) const
+{
+	// Only the pages up to the end of the character list are read, since the pass stops there.
+	fs::MappedFile file;
+	if (!file.open(replayFile))
+	{
+		return false;
+	}
+
+	StringView text(file.getData(), file.getSize());
+
+	// Skip UTF-8 byte order mark. Other encodings are left to pugixml.
+	if (text.startsWith("\xEF\xBB\xBF"))
+	{
+		text = text.substr(3);
+	}
+
+	std::map<sf::Uint64, std::size_t> playerMap;
+	std::vector<StringView> openElements;
+	XmlTagReader reader(text);
+
+	bool foundReplay = false;
+	bool foundHash = false;
+	bool foundCharacters = false;
+	bool inCharacters = false;
+	bool charactersDone = false;
+
+	while (true)
+	{
+		XmlTagReader::TagType type = reader.next();
+
+		if (type == XmlTagReader::Error)
+		{
+			return false;
+		}
+		else if (type == XmlTagReader::EndOfInput)
+		{
+			// Truncated files and files without a replay element are left to pugixml.
+			return foundReplay && openElements.empty();
+		}
+		else if (type == XmlTagReader::EndTag)
+		{
+			if (openElements.empty() || openElements.back() != reader.getName())
+			{
+				return false;
+			}
+			openElements.pop_back();
+
+			if (inCharacters && openElements.size() == 1)
+			{
+				inCharacters = false;
+				charactersDone = true;
+			}
+			else if (openElements.empty())
+			{
+				// Closed the replay element; everything of interest has been read.
+				return true;
+			}
+		}
+		else
+		{
+			std::size_t depth = openElements.size();
+			StringView name = reader.getName();
+
+			if (depth == 0)
+			{
+				if (foundReplay || name != "Replay")
+				{
+					return false;
+				}
+				foundReplay = true;
+				info.countStats = getIntegerAttribute(reader, "onlineMatch", 1) != 0;
+			}
+			else if (depth == 1 && name == "Hash" && !foundHash)
+			{
+				foundHash = true;
+				info.hash = ReplayInfo::Hash(getStringAttribute(reader, "hash", ""));
+			}
+			else if (depth == 1 && name == "Characters" && !foundCharacters)
+			{
+				foundCharacters = true;
+				inCharacters = (type == XmlTagReader::StartTag);
+				charactersDone = !inCharacters;
+			}
+			else if (depth == 2 && inCharacters)
+			{
+				CharacterAttributes attributes;
+				attributes.isBot = getIntegerAttribute(reader, "isBot", 1) == 1;
+				attributes.steamID = getStringAttribute(reader, "steamId", "#0");
+				attributes.sponsorSteamID = getStringAttribute(reader, "sponsorSteamId", attributes.steamID);
+				attributes.blueTeam = getIntegerAttribute(reader, "team", 0) != 0;
+				attributes.className = getStringAttribute(reader, "className", "");
+				attributes.skin = getIntegerAttribute(reader, "skin", 0);
+				attributes.isLocal = getIntegerAttribute(reader, "local", 0) != 0;
+				addCharacter(info, playerMap, attributes);
+			}
+
+			if (type == XmlTagReader::StartTag)
+			{
+				openElements.push_back(name);
+			}
+		}
+
+		if (charactersDone && foundHash)
+		{
+			return true;
+		}
+	}
+}
+
+bool ReplayParser::parseDocument(ReplayInfo & info) const
+{
+	std::map<sf::Uint64, std::size_t> playerMap;
+
+	pugi::xml_document doc;
+	pugi::xml_parse_result result = doc.load_file(replayFile.c_str());
+
+	if (!result)
+	{
+		debug() << "Failed to parse " << replayFile << ": " << result.description();
+		return false;
+	}
+
+	pugi::xml_node replay = doc.root().child("Replay");
+
+	if (replay.attribute("onlineMatch").as_uint(1))
+	{
+		info.countStats = true;
+	}
+
+	info.hash = ReplayInfo::Hash(replay.child("Hash").attribute("hash").as_string(""));
+
+	pugi::xml_node characters = replay.child("Characters");
+
+	for (const auto & character : characters)
+	{
+		CharacterAttributes attributes;
+		attributes.isBot = character.attribute("isBot").as_uint(1) == 1;
+		attributes.steamID = character.attribute("steamId").as_string("#0");
+		attributes.sponsorSteamID = character.attribute("sponsorSteamId").as_string(attributes.steamID.c_str());
+		attributes.blueTeam = character.attribute("team").as_uint(0) != 0;
+		attributes.className = character.attribute("className").as_string();
+		attributes.skin = character.attribute("skin").as_int(0);
+		attributes.isLocal = character.attribute("local").as_uint(0);
+		addCharacter(info, playerMap, attributes);
+	}
+
+	return true;
+}
+
+void ReplayParser::addCharacter(ReplayInfo & info, std::map<sf::Uint64, std::size_t> & playerMap,
+	const CharacterAttributes & attributes)
+{
+	if (attributes.isBot)
+	{
+		return;
+	}
+
+	PlayerData player;
+
+	auto steamID = parseSteamID(attributes.steamID);
+	auto sponsorID = parseSteamID(attributes.sponsorSteamID);
+
+	player.steamID = steamID.second;
+	player.currentName = steamID.first;
+	player.team = attributes.blueTeam ? PlayerData::Blue : PlayerData::Red;
+	player.currentNaut = NautsNames::getInstance().resolveClassName(attributes.className);
+	player.currentSkin = attributes.skin;
+	player.isLocal = attributes.isLocal;
+
+	if (player.isLocal)
+	{
+		info.localTeam = player.team;
+	}
+
+	PlayerData sponsor;
+
+	if (sponsorID != steamID && sponsorID.second != 0)
+	{
+		sponsor = player;
+		sponsor.type = PlayerData::Sponsor;
+		sponsor.currentName = sponsorID.first;
+		sponsor.steamID = sponsorID.second;
+		sponsor.currentNaut = 0;
+		sponsor.currentSkin = 0;
+		sponsor.isLocal = false;
+
+		player.type = PlayerData::SponsoredPlayer;
+	}
+	else
+	{
+		player.type = PlayerData::Player;
+	}
+
+	PlayerInfo playerInfo { player, sponsor };
+
+	if (playerMap.count(steamID.second))
+	{
+		info.players[playerMap[steamID.second]] = playerInfo;
+	}
+	else
+	{
+		playerMap[steamID.second] = info.players.size();
+		info.players.push_back(playerInfo);
+	}
+}
+
 ReplayParser::ReplayInfo::Hash::Hash(std::string hash)
 {
 	static const std::size_t groupSize = 8;
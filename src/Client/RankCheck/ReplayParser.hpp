@@ -5,12 +5,19 @@
 #include <SFML/Config.hpp>
 #include <array>
 #include <cstddef>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 class DataStream;
 
+/**
+ * Extracts the match hash and the participating players from a "Replays.info" file.
+ *
+ * The file is read in a single forward pass that only looks at the required elements and stops once the character list
+ * has been read. Files that this pass cannot handle are loaded into a full XML document instead.
+ */
 class ReplayParser
 {
 public:
@@ -41,7 +48,29 @@ public:
 
 	ReplayInfo parse();
 
+	/**
+	 * The two passes used by parse(), available separately for comparing them. Both return false if they cannot read
+	 * the file.
+	 */
+	bool parseStreaming(ReplayInfo & info) const;
+	bool parseDocument(ReplayInfo & info) const;
+
 private:
+
+	struct CharacterAttributes
+	{
+		bool isBot = true;
+		std::string steamID;
+		std::string sponsorSteamID;
+		bool blueTeam = false;
+		std::string className;
+		int skin = 0;
+		bool isLocal = false;
+	};
+
+	static void addCharacter(ReplayInfo & info, std::map<sf::Uint64, std::size_t> & playerMap,
+		const CharacterAttributes & attributes);
+
 	std::string replayFile;
 };
 
@@ -1,28 +1,38 @@
 #include <Client/RankCheck/LeagueReader.hpp>
 #include <Client/RankCheck/UsernameLookup.hpp>
-#include <SFML/Network/Http.hpp>
-#include <SFML/System/Time.hpp>
 #include <Shared/Config/DataTypes.hpp>
 #include <Shared/Config/JSONConfig.hpp>
 #include <Shared/Utils/DebugLog.hpp>
 #include <pugixml.hpp>
-#include <Shared/Utils/MakeUnique.hpp>
 #include <Shared/Utils/StrNumCon.hpp>
 #include <algorithm>
 #include <exception>
 #include <iterator>
 #include <utility>
 
-UsernameLookup::UsernameLookup()
+// Names rarely change, but a lookup failure may be temporary.
+static const sf::Int64 nameTimeToLive = 24 * 60 * 60;
+static const sf::Int64 unknownNameTimeToLive = 5 * 60;
+static const std::size_t maxCachedNames = 4096;
+
+// Batching is given up after this many batched responses in a row that do not identify any player, since a batch of
+// players the server does not know gets such a response as well.
+static const unsigned int maxUnidentifiedBatches = 3;
+
+static const std::string unknownName = "[unknown]";
+
+UsernameLookup::UsernameLookup(HttpClient & client, ThreadPool & pool) :
+	client(client),
+	pool(pool),
+	port(0),
+	cache("usernames.cache", maxCachedNames, nameTimeToLive),
+	cancelFlag(std::make_shared<std::atomic_bool>(false))
 {
 }
 
 UsernameLookup::~UsernameLookup()
 {
-	for (const auto & conn : connections)
-	{
-		conn->thread.join();
-	}
+	cancel();
 }
 
 void UsernameLookup::setHost(std::string host, unsigned short port)
@@ -31,83 +41,191 @@ void UsernameLookup::setHost(std::string host, unsigned short port)
 	this->port = port;
 }
 
-void UsernameLookup::setUriParameters(std::string prefix, std::string suffix)
+void UsernameLookup::setUriParameters(std::string prefix, std::string separator, std::string suffix)
 {
 	uriPrefix = prefix;
+	uriSeparator = separator;
 	uriSuffix = suffix;
 }
 
 void UsernameLookup::lookup(sf::Uint64 steamID, Callback callback)
 {
-	auto cacheEntry = cache.find(steamID);
-	if (cacheEntry != cache.end())
+	std::string cachedName;
+	if (cache.get(cNtoS(steamID), cachedName))
+	{
+		callback(cachedName);
+		return;
+	}
+
+	auto inFlight = inFlightRequests.find(steamID);
+	if (inFlight != inFlightRequests.end())
+	{
+		(*inFlight->second)[steamID].push_back(std::move(callback));
+		return;
+	}
+
+	pendingRequests[steamID].push_back(std::move(callback));
+}
+
+void UsernameLookup::sendRequestIfNeeded()
+{
+	if (pendingRequests.empty())
+	{
+		return;
+	}
+
+	if (uriSeparator.empty() || !batchingSupported)
 	{
-		if (!cacheEntry->second.timer.expired())
+		for (auto & request : pendingRequests)
 		{
-			callback(cacheEntry->second.name);
-			return;
+			auto callbacks = std::make_shared<CallbackMap>();
+			(*callbacks)[request.first] = std::move(request.second);
+			sendRequest(callbacks);
 		}
 	}
+	else
+	{
+		sendRequest(std::make_shared<CallbackMap>(std::move(pendingRequests)));
+	}
+	pendingRequests.clear();
+}
 
-	std::unique_ptr<Connection> conn = makeUnique<Connection>();
-	conn->callback = callback;
-	conn->steamID = steamID;
-	Connection * connPtr = conn.get();
-
-	conn->thread = std::thread([this,connPtr]()
+void UsernameLookup::sendRequest(std::shared_ptr<CallbackMap> callbacks)
+{
+	std::vector<sf::Uint64> steamIDs;
+	std::string queryString;
+	for (const auto & request : *callbacks)
 	{
-		sf::Http http;
-		http.setHost(host, port);
+		if (!steamIDs.empty())
+		{
+			queryString += uriSeparator;
+		}
+		steamIDs.push_back(request.first);
+		queryString += cNtoS(request.first);
+		inFlightRequests[request.first] = callbacks;
+	}
 
-		sf::Http::Request request;
-		request.setUri(uriPrefix + cNtoS(connPtr->steamID) + uriSuffix);
+	HttpClient & client = this->client;
+	std::string host = this->host;
+	unsigned short port = this->port;
+	std::string uri = uriPrefix + queryString + uriSuffix;
+	HttpClient::CancelFlag cancelled = cancelFlag;
+	auto answered = std::make_shared<bool>(false);
+	auto wellFormed = std::make_shared<bool>(false);
+	auto names = std::make_shared<std::map<sf::Uint64, std::string> >();
 
-		sf::Http::Response response = http.sendRequest(request);
-		connPtr->result = parseResponse(response.getBody());
-		connPtr->done = true;
-	});
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<ThreadPool::Job> & job)
+	{
+		return job->isFinished();
+	}), jobs.end());
 
-	connections.push_back(std::move(conn));
+	jobs.push_back(pool.submit([&client,host,port,uri,steamIDs,cancelled,answered,wellFormed,names]()
+	{
+		HttpClient::Response response = client.get(host, port, uri, cancelled);
+		*answered = (response.status / 100 == 2);
+		if (*answered)
+		{
+			*wellFormed = parseResponse(response.body, steamIDs, *names);
+		}
+	},
+	[this,callbacks,answered,wellFormed,names]()
+	{
+		handleResponse(*answered, *wellFormed, *names, *callbacks);
+	}));
 }
 
-void UsernameLookup::process()
+void UsernameLookup::handleResponse(bool answered, bool wellFormed, const std::map<sf::Uint64, std::string> & names,
+	const CallbackMap & callbacks)
 {
-	for (auto it = connections.begin(); it != connections.end();)
+	for (const auto & request : callbacks)
 	{
-		Connection & connection = **it;
-		if (connection.done)
+		auto inFlight = inFlightRequests.find(request.first);
+		if (inFlight != inFlightRequests.end() && inFlight->second.get() == &callbacks)
 		{
-			Countdown countdown;
-			countdown.restart(sf::seconds(300));
-			cache.insert(std::make_pair(connection.steamID, CacheEntry { connection.result, countdown }));
-			connection.callback(connection.result);
-			connection.thread.detach();
-			it = connections.erase(it);
+			inFlightRequests.erase(inFlight);
+		}
+	}
+
+	// The server is unreachable, too slow or failing; splitting the request up or caching the failure would not help.
+	if (!answered)
+	{
+		for (const auto & request : callbacks)
+		{
+			for (const auto & callback : request.second)
+			{
+				callback(unknownName);
+			}
+		}
+		return;
+	}
+
+	if (callbacks.size() > 1 && wellFormed && batchingSupported)
+	{
+		unidentifiedBatchCount = names.empty() ? unidentifiedBatchCount + 1 : 0;
+		if (unidentifiedBatchCount >= maxUnidentifiedBatches)
+		{
+			debug() << "Username server did not answer batched requests, looking up names one at a time.";
+			batchingSupported = false;
+		}
+	}
+
+	for (const auto & request : callbacks)
+	{
+		auto it = names.find(request.first);
+		if (it == names.end() && callbacks.size() > 1)
+		{
+			// Players missing from a batched response are looked up on their own.
+			auto single = std::make_shared<CallbackMap>();
+			(*single)[request.first] = request.second;
+			sendRequest(single);
+			continue;
+		}
+
+		std::string name = (it == names.end()) ? unknownName : it->second;
+		if (name == unknownName)
+		{
+			cache.set(cNtoS(request.first), name, unknownNameTimeToLive);
 		}
 		else
 		{
-			++it;
+			cache.set(cNtoS(request.first), name);
+		}
+
+		for (const auto & callback : request.second)
+		{
+			callback(name);
 		}
 	}
 }
 
-std::string UsernameLookup::getCachedName(sf::Uint64 steamID) const
+void UsernameLookup::cancel()
 {
-	auto it = cache.find(steamID);
-	if (it == cache.end())
-	{
-		return "";
-	}
-	else
+	pendingRequests.clear();
+	inFlightRequests.clear();
+	*cancelFlag = true;
+	cancelFlag = std::make_shared<std::atomic_bool>(false);
+	for (const auto & job : jobs)
 	{
-		return it->second.name;
+		job->cancel();
 	}
+	jobs.clear();
 }
 
-std::string UsernameLookup::parseResponse(const std::string& response)
+void UsernameLookup::saveCache()
 {
-	static const std::string unknown = "[unknown]";
+	cache.save();
+}
+
+std::string UsernameLookup::getCachedName(sf::Uint64 steamID)
+{
+	std::string name;
+	cache.get(cNtoS(steamID), name);
+	return name;
+}
 
+bool UsernameLookup::parseResponse(const std::string & response, const std::vector<sf::Uint64> & steamIDs,
+	std::map<sf::Uint64, std::string> & names)
+{
 	cfg::JSONConfig config;
 	try
 	{
@@ -116,10 +234,24 @@ std::string UsernameLookup::parseResponse(const std::string& response)
 	catch (std::exception & e)
 	{
 		debug() << e.what();
-		return unknown;
+		return false;
 	}
 
-	std::string name = config.readValue("result[0].username").content;
+	for (std::size_t i = 0; i < cStoUL(config.readValue("result.length").content); ++i)
+	{
+		std::string entry = "result[" + cNtoS(i) + "].";
+		std::string name = config.readValue(entry + "username").content;
+		std::string steamID = config.readValue(entry + "steamid").content;
+
+		if (!steamID.empty())
+		{
+			names[cStoUL(steamID)] = name.empty() ? unknownName : name;
+		}
+		else if (steamIDs.size() == 1 && i == 0)
+		{
+			names[steamIDs[0]] = name.empty() ? unknownName : name;
+		}
+	}
 
-	return name.empty() ? unknown : name;
+	return true;
 }
@@ -1,18 +1,16 @@
 #ifndef SRC_CLIENT_RANKCHECK_USERNAMELOOKUP_HPP_
 #define SRC_CLIENT_RANKCHECK_USERNAMELOOKUP_HPP_
 
+#include <Client/RankCheck/HttpClient.hpp>
+#include <Client/RankCheck/LookupCache.hpp>
 #include <SFML/Config.hpp>
-#include <Shared/Utils/Timer.hpp>
+#include <Shared/Utils/ThreadPool.hpp>
 #include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
-#include <thread>
 #include <vector>
-#include <mutex>
-#include <thread>
-#include <condition_variable>
 
 namespace sf
 {
@@ -22,44 +20,77 @@ class String;
 class UsernameLookup
 {
 public:
-	UsernameLookup();
+	/**
+	 * Lookups are sent on the pool's threads, and the callbacks are run by ThreadPool::processCallbacks().
+	 */
+	UsernameLookup(HttpClient & client, ThreadPool & pool);
 	~UsernameLookup();
 
 	using Callback = std::function<void(std::string)>;
 
 	void setHost(std::string host, unsigned short port);
-	void setUriParameters(std::string prefix, std::string suffix);
 
+	/**
+	 * Several SteamIDs are looked up in one request by joining them with the separator. Without a separator, every
+	 * SteamID is looked up in a request of its own.
+	 */
+	void setUriParameters(std::string prefix, std::string separator, std::string suffix);
+
+	/**
+	 * Calls the callback immediately if the name is cached. Otherwise, the SteamID is looked up along with all others
+	 * added until the next call to sendRequestIfNeeded().
+	 */
 	void lookup(sf::Uint64 steamID, Callback callback);
-	std::string getCachedName(sf::Uint64 steamID) const;
-	void process();
+	void sendRequestIfNeeded();
+
+	std::string getCachedName(sf::Uint64 steamID);
+
+	/**
+	 * Drops all pending lookups without calling their callbacks.
+	 */
+	void cancel();
+
+	/**
+	 * Writes the cached names to disk, if any have been added.
+	 */
+	void saveCache();
 
 private:
 
-	static std::string parseResponse(const std::string & response);
+	using CallbackMap = std::map<sf::Uint64, std::vector<Callback> >;
 
-	struct Connection
-	{
-		sf::Uint64 steamID;
-		std::atomic_bool done = ATOMIC_VAR_INIT(false);
-		std::thread thread;
-		std::string result;
-		Callback callback;
-	};
+	void sendRequest(std::shared_ptr<CallbackMap> callbacks);
+	void handleResponse(bool answered, bool wellFormed, const std::map<sf::Uint64, std::string> & names,
+		const CallbackMap & callbacks);
 
-	struct CacheEntry
-	{
-		std::string name;
-		Countdown timer;
-	};
+	/**
+	 * Adds the names found in the response. For a single SteamID, the response does not need to identify players.
+	 * Returns false if the response is not valid JSON.
+	 */
+	static bool parseResponse(const std::string & response, const std::vector<sf::Uint64> & steamIDs,
+		std::map<sf::Uint64, std::string> & names);
 
+	HttpClient & client;
+	ThreadPool & pool;
 	std::string host;
 	unsigned short port;
 	std::string uriPrefix;
+	std::string uriSeparator;
 	std::string uriSuffix;
 
-	std::map<sf::Uint64, CacheEntry> cache;
-	std::vector<std::unique_ptr<Connection> > connections;
+	// Cleared once the server answers several batched requests in a row without identifying any player.
+	bool batchingSupported = true;
+	unsigned int unidentifiedBatchCount = 0;
+
+	CallbackMap pendingRequests;
+
+	// Callbacks of the requests that have been sent but not answered yet, by SteamID.
+	std::map<sf::Uint64, std::shared_ptr<CallbackMap> > inFlightRequests;
+
+	LookupCache cache;
+	std::vector<std::shared_ptr<ThreadPool::Job> > jobs;
+	// Shared with the requests sent so far, which are abandoned once it is set. Replaced by cancel().
+	std::shared_ptr<std::atomic_bool> cancelFlag;
 };
 
 #endif
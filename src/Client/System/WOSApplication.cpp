@@ -424,6 +424,12 @@ void WOSApplication::addBasicMenuEntries()
 		settingsPanel->setVisible(false);
 	}, "Rebuild player database");
 
+	settingsPanel->addButton([=]()
+	{
+		rankCheck->requestPlayerDBRebuild(true);
+		settingsPanel->setVisible(false);
+	}, "Rebuild player database from scratch");
+
 	settingsPanel->addButton([=]()
 	{
 		rankCheck->showGameDirChooser();
@@ -157,6 +157,11 @@ bool DirectoryObserver::isWatching() const
 	return watching;
 }
 
+bool DirectoryObserver::isActive() const
+{
+	return impl != nullptr;
+}
+
 void DirectoryObserver::updateSettings()
 {
 	if (isWatching())
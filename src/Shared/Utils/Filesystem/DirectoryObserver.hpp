@@ -46,6 +46,11 @@ public:
 	void stopWatching();
 	bool isWatching() const;
 
+	/**
+	 * Returns true if change notifications are actually being delivered for the watched directory.
+	 */
+	bool isActive() const;
+
 private:
 
 	void updateSettings();
@@ -65,4 +65,24 @@ bool FileObserver::poll()
 	return false;
 }
 
+int FileObserver::pollEvents()
+{
+	DirectoryObserver::Event event;
+	int eventTypes = 0;
+
+	while (directoryObserver.pollEvent(event))
+	{
+		if (event.filename == target)
+		{
+			eventTypes |= event.type;
+		}
+	}
+	return eventTypes;
+}
+
+bool FileObserver::isActive() const
+{
+	return directoryObserver.isActive();
+}
+
 }
@@ -21,6 +21,13 @@ public:
 
 	bool poll();
 
+	/**
+	 * Consumes all pending events for the target file and returns the combination of their event types.
+	 */
+	int pollEvents();
+
+	bool isActive() const;
+
 private:
 	DirectoryObserver directoryObserver;
 	std::string target;
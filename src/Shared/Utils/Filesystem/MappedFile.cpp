@@ -0,0 +1,59 @@
+#include <Poco/File.h>
+#include <Poco/SharedMemory.h>
+#include <Shared/Utils/Filesystem/MappedFile.hpp>
+#include <exception>
+
+namespace fs
+{
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+}
+
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+
+	try
+	{
+		Poco::File file(filename);
+		if (!file.exists() || file.getSize() == 0)
+		{
+			return false;
+		}
+
+		memory.reset(new Poco::SharedMemory(file, Poco::SharedMemory::AM_READ));
+		return true;
+	}
+	catch (std::exception & ex)
+	{
+		memory.reset();
+		return false;
+	}
+}
+
+void MappedFile::close()
+{
+	memory.reset();
+}
+
+bool MappedFile::isOpen() const
+{
+	return memory != nullptr;
+}
+
+const char * MappedFile::getData() const
+{
+	return memory ? memory->begin() : nullptr;
+}
+
+std::size_t MappedFile::getSize() const
+{
+	return memory ? memory->end() - memory->begin() : 0;
+}
+
+}
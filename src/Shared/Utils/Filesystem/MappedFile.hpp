@@ -0,0 +1,44 @@
+#ifndef SRC_SHARED_UTILS_FILESYSTEM_MAPPEDFILE_HPP_
+#define SRC_SHARED_UTILS_FILESYSTEM_MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace Poco
+{
+class SharedMemory;
+}
+
+namespace fs
+{
+
+/**
+ * Read-only memory mapping of an entire file.
+ *
+ * The mapped contents stay valid until the file is closed, even if the file is replaced on disk in the meantime.
+ */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	/**
+	 * Maps the specified file. Returns false if the file does not exist, is empty or cannot be mapped.
+	 */
+	bool open(const std::string & filename);
+	void close();
+
+	bool isOpen() const;
+
+	const char * getData() const;
+	std::size_t getSize() const;
+
+private:
+	std::unique_ptr<Poco::SharedMemory> memory;
+};
+
+}
+
+#endif
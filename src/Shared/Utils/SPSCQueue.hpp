@@ -0,0 +1,89 @@
+#ifndef SRC_SHARED_UTILS_SPSCQUEUE_HPP_
+#define SRC_SHARED_UTILS_SPSCQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-capacity ring buffer for passing items from one producer thread to one consumer thread without locking.
+ *
+ * push() may only be called from the producer thread, pop() only from the consumer thread. Neither operation blocks:
+ * push() fails if the queue is full, pop() fails if it is empty.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+
+	explicit SPSCQueue(std::size_t capacity) :
+		buffer(capacity + 1),
+		head(0),
+		tail(0)
+	{
+	}
+
+	/**
+	 * Appends an item to the queue. Returns false without modifying the item if the queue is full.
+	 */
+	bool push(T && item)
+	{
+		std::size_t currentTail = tail.load(std::memory_order_relaxed);
+		std::size_t nextTail = increment(currentTail);
+		if (nextTail == head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		buffer[currentTail] = std::move(item);
+		tail.store(nextTail, std::memory_order_release);
+		return true;
+	}
+
+	bool push(const T & item)
+	{
+		T copy = item;
+		return push(std::move(copy));
+	}
+
+	/**
+	 * Removes the oldest item from the queue. Returns false if the queue is empty.
+	 */
+	bool pop(T & item)
+	{
+		std::size_t currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		item = std::move(buffer[currentHead]);
+		buffer[currentHead] = T();
+		head.store(increment(currentHead), std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	std::size_t getCapacity() const
+	{
+		return buffer.size() - 1;
+	}
+
+private:
+
+	std::size_t increment(std::size_t index) const
+	{
+		return index + 1 == buffer.size() ? 0 : index + 1;
+	}
+
+	std::vector<T> buffer;
+
+	// Kept on separate cache lines, since each index is written by a different thread.
+	alignas(64) std::atomic<std::size_t> head;
+	alignas(64) std::atomic<std::size_t> tail;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include <Shared/Utils/StringMatcher.hpp>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+const std::size_t StringMatcher::npos;
+
+StringMatcher::StringMatcher() :
+	minLength(0),
+	commonFirstByte(-1)
+{
+	bucketStart.fill(0);
+}
+
+std::size_t StringMatcher::addPattern(std::string pattern)
+{
+	patterns.push_back(std::move(pattern));
+	compile();
+	return patterns.size() - 1;
+}
+
+std::size_t StringMatcher::getPatternCount() const
+{
+	return patterns.size();
+}
+
+std::size_t StringMatcher::match(StringView text, std::vector<std::size_t> & positions) const
+{
+	positions.assign(patterns.size(), npos);
+
+	if (patterns.empty() || text.size() < minLength)
+	{
+		return 0;
+	}
+
+	std::size_t found = 0;
+	std::size_t lastStart = text.size() - minLength;
+
+	for (std::size_t pos = 0; pos <= lastStart; ++pos)
+	{
+		if (commonFirstByte >= 0)
+		{
+			pos = text.find(char(commonFirstByte), pos);
+			if (pos == npos || pos > lastStart)
+			{
+				break;
+			}
+		}
+
+		unsigned char byte = text[pos];
+		unsigned char nextByte = pos + 1 < text.size() ? text[pos + 1] : 0;
+		if (!bigrams[byte * 256 + nextByte])
+		{
+			continue;
+		}
+
+		for (std::size_t i = bucketStart[byte]; i < bucketStart[byte + 1]; ++i)
+		{
+			std::size_t index = bucketPatterns[i];
+			const std::string & pattern = patterns[index];
+
+			if (positions[index] == npos && pattern.size() <= text.size() - pos
+				&& std::memcmp(text.data() + pos, pattern.data(), pattern.size()) == 0)
+			{
+				positions[index] = pos;
+				if (++found == patterns.size())
+				{
+					return found;
+				}
+			}
+		}
+	}
+
+	return found;
+}
+
+void StringMatcher::compile()
+{
+	std::array<std::size_t, 256> counts;
+	counts.fill(0);
+	bigrams.reset();
+
+	minLength = patterns.empty() ? 0 : patterns[0].size();
+	commonFirstByte = patterns.empty() || patterns[0].empty() ? -1 : (unsigned char) patterns[0][0];
+
+	for (const std::string & pattern : patterns)
+	{
+		minLength = std::min(minLength, pattern.size());
+		if (pattern.empty() || (unsigned char) pattern[0] != commonFirstByte)
+		{
+			commonFirstByte = -1;
+		}
+		if (!pattern.empty())
+		{
+			unsigned char byte = pattern[0];
+			counts[byte]++;
+
+			if (pattern.size() == 1)
+			{
+				for (std::size_t nextByte = 0; nextByte < 256; ++nextByte)
+				{
+					bigrams[byte * 256 + nextByte] = true;
+				}
+			}
+			else
+			{
+				bigrams[byte * 256 + (unsigned char) pattern[1]] = true;
+			}
+		}
+	}
+
+	bucketStart[0] = 0;
+	for (std::size_t byte = 0; byte < 256; ++byte)
+	{
+		bucketStart[byte + 1] = bucketStart[byte] + counts[byte];
+	}
+
+	bucketPatterns.resize(bucketStart[256]);
+	std::array<std::size_t, 256> fill;
+	std::copy(bucketStart.begin(), bucketStart.end() - 1, fill.begin());
+
+	for (std::size_t index = 0; index < patterns.size(); ++index)
+	{
+		if (!patterns[index].empty())
+		{
+			bucketPatterns[fill[(unsigned char) patterns[index][0]]++] = index;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef SRC_SHARED_UTILS_STRINGMATCHER_HPP_
+#define SRC_SHARED_UTILS_STRINGMATCHER_HPP_
+
+#include <Shared/Utils/StringView.hpp>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Searches a text for a fixed set of patterns in a single pass.
+ *
+ * Patterns are bucketed by their first byte. While scanning, a position is only compared against the patterns in its
+ * bucket if its first two bytes begin at least one pattern, which is checked in a bigram bitmap. If all patterns share
+ * the same first byte, candidate positions are located with memchr.
+ */
+class StringMatcher
+{
+public:
+
+	static const std::size_t npos = StringView::npos;
+
+	StringMatcher();
+
+	/**
+	 * Registers a non-empty pattern and returns its index in the position list filled by match().
+	 */
+	std::size_t addPattern(std::string pattern);
+
+	std::size_t getPatternCount() const;
+
+	/**
+	 * Stores the position of the first occurrence of each pattern in the text in positions, or npos for patterns that
+	 * do not occur. Returns the number of patterns that were found.
+	 */
+	std::size_t match(StringView text, std::vector<std::size_t> & positions) const;
+
+private:
+
+	void compile();
+
+	std::vector<std::string> patterns;
+
+	// Pattern indices grouped by first byte. Bucket b spans [bucketStart[b]; bucketStart[b + 1]).
+	std::array<std::size_t, 257> bucketStart;
+	std::vector<std::size_t> bucketPatterns;
+
+	// Set for each pair of bytes that starts a pattern.
+	std::bitset<256 * 256> bigrams;
+
+	std::size_t minLength;
+	int commonFirstByte;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef SRC_SHARED_UTILS_STRINGVIEW_HPP_
+#define SRC_SHARED_UTILS_STRINGVIEW_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+/**
+ * Non-owning reference to a contiguous range of characters.
+ *
+ * Mirrors the subset of the std::string interface used for parsing log lines, so that text can be inspected without
+ * copying it out of the buffer it was read into. The referenced memory must outlive the view.
+ */
+class StringView
+{
+public:
+
+	static const std::size_t npos = std::string::npos;
+
+	StringView() :
+		myData(nullptr),
+		mySize(0)
+	{
+	}
+
+	StringView(const char * data, std::size_t size) :
+		myData(data),
+		mySize(size)
+	{
+	}
+
+	StringView(const char * string) :
+		myData(string),
+		mySize(std::strlen(string))
+	{
+	}
+
+	StringView(const std::string & string) :
+		myData(string.data()),
+		mySize(string.size())
+	{
+	}
+
+	const char * data() const
+	{
+		return myData;
+	}
+
+	std::size_t size() const
+	{
+		return mySize;
+	}
+
+	bool empty() const
+	{
+		return mySize == 0;
+	}
+
+	const char * begin() const
+	{
+		return myData;
+	}
+
+	const char * end() const
+	{
+		return myData + mySize;
+	}
+
+	char operator[](std::size_t index) const
+	{
+		return myData[index];
+	}
+
+	/**
+	 * Returns a view of at most count characters starting at pos. Out-of-range positions yield an empty view.
+	 */
+	StringView substr(std::size_t pos, std::size_t count = npos) const
+	{
+		if (pos >= mySize)
+		{
+			return StringView(myData + mySize, 0);
+		}
+		return StringView(myData + pos, std::min(count, mySize - pos));
+	}
+
+	std::size_t find(char character, std::size_t pos = 0) const
+	{
+		if (pos >= mySize)
+		{
+			return npos;
+		}
+		const void * found = std::memchr(myData + pos, character, mySize - pos);
+		return found ? static_cast<const char *>(found) - myData : npos;
+	}
+
+	std::size_t find(StringView needle, std::size_t pos = 0) const
+	{
+		if (needle.empty())
+		{
+			return pos <= mySize ? pos : npos;
+		}
+
+		while (pos + needle.size() <= mySize)
+		{
+			pos = find(needle[0], pos);
+			if (pos == npos || pos + needle.size() > mySize)
+			{
+				return npos;
+			}
+			if (std::memcmp(myData + pos, needle.data(), needle.size()) == 0)
+			{
+				return pos;
+			}
+			++pos;
+		}
+		return npos;
+	}
+
+	std::size_t find_first_of(char character, std::size_t pos = 0) const
+	{
+		return find(character, pos);
+	}
+
+	std::size_t find_last_of(char character) const
+	{
+		for (std::size_t i = mySize; i > 0; --i)
+		{
+			if (myData[i - 1] == character)
+			{
+				return i - 1;
+			}
+		}
+		return npos;
+	}
+
+	bool startsWith(StringView prefix) const
+	{
+		return mySize >= prefix.size() && std::memcmp(myData, prefix.data(), prefix.size()) == 0;
+	}
+
+	bool endsWith(StringView suffix) const
+	{
+		return mySize >= suffix.size()
+			&& std::memcmp(myData + mySize - suffix.size(), suffix.data(), suffix.size()) == 0;
+	}
+
+	std::string toString() const
+	{
+		return std::string(myData, mySize);
+	}
+
+	bool operator==(StringView other) const
+	{
+		return mySize == other.size() && std::memcmp(myData, other.data(), mySize) == 0;
+	}
+
+	bool operator!=(StringView other) const
+	{
+		return !operator==(other);
+	}
+
+private:
+
+	const char * myData;
+	std::size_t mySize;
+};
+
+inline std::ostream & operator<<(std::ostream & stream, StringView view)
+{
+	return stream.write(view.data(), view.size());
+}
+
+#endif
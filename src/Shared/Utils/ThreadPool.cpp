@@ -0,0 +1,112 @@
+#include <Shared/Utils/ThreadPool.hpp>
+#include <algorithm>
+#include <utility>
+
+void ThreadPool::Job::cancel()
+{
+	cancelled = true;
+	finished = true;
+}
+
+bool ThreadPool::Job::isFinished() const
+{
+	return finished;
+}
+
+ThreadPool::ThreadPool(std::size_t threadCount)
+{
+	threadCount = std::max<std::size_t>(threadCount, 1);
+	for (std::size_t i = 0; i < threadCount; ++i)
+	{
+		threads.emplace_back([this]()
+		{
+			work();
+		});
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	condition.notify_all();
+
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+}
+
+std::shared_ptr<ThreadPool::Job> ThreadPool::submit(Task task, Task callback)
+{
+	auto job = std::make_shared<Job>();
+	job->task = std::move(task);
+	job->callback = std::move(callback);
+	job->cancelled = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(job);
+	}
+	condition.notify_one();
+	return job;
+}
+
+void ThreadPool::processCallbacks()
+{
+	std::vector<std::shared_ptr<Job> > jobs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.swap(completed);
+	}
+
+	for (const auto & job : jobs)
+	{
+		if (!job->cancelled)
+		{
+			job->finished = true;
+			if (job->callback)
+			{
+				job->callback();
+			}
+		}
+	}
+}
+
+std::size_t ThreadPool::getThreadCount() const
+{
+	return threads.size();
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]()
+			{
+				return stopping || !queue.empty();
+			});
+			if (queue.empty())
+			{
+				return;
+			}
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		if (!job->cancelled)
+		{
+			job->task();
+			job->task = Task();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		completed.push_back(std::move(job));
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef SRC_SHARED_UTILS_THREADPOOL_HPP_
+#define SRC_SHARED_UTILS_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed number of worker threads running queued tasks in submission order.
+ *
+ * Each task may come with a callback, which is run by processCallbacks() once the task has finished. Calling
+ * processCallbacks() regularly from the thread owning the pool, such as the UI thread, hands the results of background
+ * work back to that thread without further synchronization.
+ */
+class ThreadPool
+{
+public:
+
+	using Task = std::function<void()>;
+
+	class Job
+	{
+	public:
+
+		/**
+		 * Keeps the task from starting if it is still queued, and its callback from being run. Has to be called from
+		 * the thread that calls processCallbacks().
+		 */
+		void cancel();
+
+		/**
+		 * Returns true once the callback has been run or the job has been cancelled.
+		 */
+		bool isFinished() const;
+
+	private:
+
+		friend class ThreadPool;
+
+		Task task;
+		Task callback;
+		std::atomic_bool cancelled;
+		bool finished = false;
+	};
+
+	explicit ThreadPool(std::size_t threadCount);
+
+	/**
+	 * Discards all queued tasks and waits for the running ones to finish. Pending callbacks are not run.
+	 */
+	~ThreadPool();
+
+	std::shared_ptr<Job> submit(Task task, Task callback = Task());
+
+	/**
+	 * Runs the callbacks of all tasks that have finished since the last call, in the order the tasks finished.
+	 */
+	void processCallbacks();
+
+	std::size_t getThreadCount() const;
+
+private:
+
+	void work();
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<std::shared_ptr<Job> > queue;
+	std::vector<std::shared_ptr<Job> > completed;
+	bool stopping = false;
+
+	std::vector<std::thread> threads;
+};
+
+#endif